@@ -0,0 +1,486 @@
+#ifndef _AIO_
+#define _AIO_
+
+#ifdef __linux__
+#if __has_include (<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define AIO_HAVE_URING 1
+#endif
+#endif
+
+/**
+ * Asynchronous whole-file reads.
+ *
+ * aio_read() opens the file right away (so the caller knows whether it
+ * exists) and queues the read; queued reads go to the kernel together on
+ * the next aio_submit(), aio_poll() or aio_wait(). With io_uring they are
+ * one io_uring_enter() for the whole batch, without it each read is a
+ * blocking read on the worker pool. Either way the caller gets a request
+ * it can poll or wait on, and owns the buffer once it is done.
+ *
+ * The io_uring side uses the raw syscalls, no liburing, and is only
+ * driven from one thread (the one doing setup).
+ */
+
+#define AIO_RING_ENTRIES 64
+
+enum aio_status
+{
+    AIO_PENDING = 0,
+    AIO_DONE,
+    AIO_FAILED
+};
+
+enum aio_backend
+{
+    AIO_THREADS = 0,
+    AIO_URING
+};
+
+struct aio_request
+{
+    char path[320];
+    void *data;             // malloc'd, not terminated
+    size_t len;
+    size_t read;
+    SDL_atomic_t status;
+    Uint64 submitted;
+
+    /* threads */
+    FILE *fp;
+    struct job job;
+
+    /* io_uring */
+    int fd;
+};
+
+struct aio
+{
+    enum aio_backend backend;
+    bool initialised;
+
+    unsigned int reads;
+    unsigned int failed;
+    unsigned long long bytes;
+    double wait_ms;         // time callers spent blocked in aio_wait()
+
+#ifdef AIO_HAVE_URING
+    int ring_fd;
+    unsigned int queued;    // in the SQ, not yet handed to the kernel
+    unsigned int in_flight; // submitted, no completion reaped yet
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+#endif
+};
+
+static struct aio g__aio;
+
+static char *
+_aio_backend_name (enum aio_backend backend)
+{
+    switch (backend)
+    {
+        case AIO_THREADS: return "threads";
+        case AIO_URING: return "io_uring";
+        default: return "???";
+    }
+}
+
+static void
+_aio_finish (struct aio_request *r, bool ok)
+{
+    struct aio *a = &g__aio;
+
+    if (ok)
+    {
+        a->reads++;
+        a->bytes += r->read;
+        r->len = r->read;
+    }
+    else
+    {
+        a->failed++;
+        free (r->data);
+        r->data = NULL;
+    }
+
+    SDL_AtomicSet (&r->status, ok ? AIO_DONE : AIO_FAILED);
+}
+
+/* Thread pool backend ------------------------------------------------ */
+
+static void
+_aio_read_job (struct job *job)
+{
+    struct aio_request *r = job->data;
+
+    r->read = fread (r->data, 1, r->len, r->fp);
+    fclose (r->fp);
+    r->fp = NULL;
+
+    /* counters are only touched from the waiting side, see aio_wait() */
+}
+
+/* io_uring backend --------------------------------------------------- */
+
+#ifdef AIO_HAVE_URING
+
+static bool
+_aio_uring_init (void)
+{
+    struct aio *a = &g__aio;
+    struct io_uring_params p = {0};
+    struct io_uring_probe *probe;
+    size_t probe_size = sizeof (*probe) + 256 * sizeof (struct io_uring_probe_op);
+    size_t sq_size;
+    size_t cq_size;
+    char *sq;
+    char *cq;
+    bool have_read;
+
+    a->ring_fd = (int) syscall (__NR_io_uring_setup, AIO_RING_ENTRIES, &p);
+    if (a->ring_fd < 0)
+    {
+        return false;
+    }
+
+    /* IORING_OP_READ needs 5.6, the same kernel that added probing */
+    probe = calloc (1, probe_size);
+    have_read = syscall (__NR_io_uring_register, a->ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+                probe->last_op >= IORING_OP_READ &&
+                (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    free (probe);
+
+    if (!have_read)
+    {
+        close (a->ring_fd);
+        return false;
+    }
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (cq_size > sq_size) sq_size = cq_size;
+        cq_size = sq_size;
+    }
+
+    sq = mmap (NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, a->ring_fd, IORING_OFF_SQ_RING);
+    cq = (p.features & IORING_FEAT_SINGLE_MMAP) ? sq :
+         mmap (NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, a->ring_fd, IORING_OFF_CQ_RING);
+    a->sqes = mmap (NULL, p.sq_entries * sizeof (struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, a->ring_fd, IORING_OFF_SQES);
+
+    if (sq == MAP_FAILED || cq == MAP_FAILED || a->sqes == MAP_FAILED)
+    {
+        close (a->ring_fd);
+        return false;
+    }
+
+    a->sq_head = (unsigned int *) (sq + p.sq_off.head);
+    a->sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+    a->sq_mask = (unsigned int *) (sq + p.sq_off.ring_mask);
+    a->sq_array = (unsigned int *) (sq + p.sq_off.array);
+    a->cq_head = (unsigned int *) (cq + p.cq_off.head);
+    a->cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+    a->cq_mask = (unsigned int *) (cq + p.cq_off.ring_mask);
+    a->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    return true;
+}
+
+static void
+_aio_uring_submit (unsigned int min_complete)
+{
+    struct aio *a = &g__aio;
+    unsigned int flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+    if (a->queued == 0 && min_complete == 0)
+    {
+        return;
+    }
+
+    if (syscall (__NR_io_uring_enter, a->ring_fd, a->queued, min_complete, flags, NULL, 0) >= 0)
+    {
+        a->in_flight += a->queued;
+        a->queued = 0;
+    }
+}
+
+static void _aio_uring_reap (void);
+
+static void
+_aio_uring_queue (struct aio_request *r)
+{
+    struct aio *a = &g__aio;
+    unsigned int tail;
+    unsigned int index;
+    struct io_uring_sqe *sqe;
+
+    /**
+     * Never more outstanding than the SQ has entries (the CQ has twice
+     * that), so neither ring can overflow: submit what is queued, then
+     * reap until a slot frees up. A short read being requeued by the
+     * reap takes the slot its first half just gave back.
+     */
+    if (a->queued + a->in_flight >= AIO_RING_ENTRIES)
+    {
+        _aio_uring_submit (0);
+        while (a->queued + a->in_flight >= AIO_RING_ENTRIES && a->in_flight > 0)
+        {
+            _aio_uring_submit (1);
+            _aio_uring_reap ();
+        }
+    }
+
+    tail = *a->sq_tail;
+    index = tail & *a->sq_mask;
+    sqe = &a->sqes[index];
+
+    memset (sqe, 0, sizeof (*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = r->fd;
+    sqe->addr = (unsigned long long) (uintptr_t) ((char *) r->data + r->read);
+    sqe->len = (unsigned int) (r->len - r->read);
+    sqe->off = r->read;
+    sqe->user_data = (unsigned long long) (uintptr_t) r;
+
+    a->sq_array[index] = index;
+    __atomic_store_n (a->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    a->queued++;
+}
+
+static void
+_aio_uring_reap (void)
+{
+    struct aio *a = &g__aio;
+    unsigned int head = *a->cq_head;
+    unsigned int tail = __atomic_load_n (a->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++)
+    {
+        struct io_uring_cqe *cqe = &a->cqes[head & *a->cq_mask];
+        struct aio_request *r = (struct aio_request *) (uintptr_t) cqe->user_data;
+
+        a->in_flight--;
+
+        if (cqe->res > 0 && r->read + cqe->res < r->len)
+        {
+            /* short read, go again for the rest */
+            r->read += cqe->res;
+            _aio_uring_queue (r);
+            continue;
+        }
+
+        if (cqe->res >= 0) r->read += cqe->res;
+        close (r->fd);
+        _aio_finish (r, cqe->res >= 0);
+    }
+
+    __atomic_store_n (a->cq_head, head, __ATOMIC_RELEASE);
+}
+
+#endif
+
+/* API ---------------------------------------------------------------- */
+
+static void
+aio_init (void)
+{
+    struct aio *a = &g__aio;
+
+    memset (a, 0, sizeof (*a));
+    a->backend = AIO_THREADS;
+
+#ifdef AIO_HAVE_URING
+    if (_aio_uring_init ())
+    {
+        a->backend = AIO_URING;
+    }
+#endif
+
+    a->initialised = true;
+    printf ("Async I/O: %s\n", _aio_backend_name (a->backend));
+}
+
+/* Returns false if the file can't be opened or sized, nothing is queued then */
+static bool
+aio_read (struct aio_request *r, const char *path)
+{
+    struct aio *a = &g__aio;
+    long len = 0;
+
+    ASSERT (a->initialised);
+
+    memset (r, 0, sizeof (*r));
+    snprintf (r->path, sizeof (r->path), "%s", path);
+    r->submitted = SDL_GetPerformanceCounter ();
+
+#ifdef AIO_HAVE_URING
+    if (a->backend == AIO_URING)
+    {
+        struct stat st;
+
+        r->fd = open (path, O_RDONLY);
+        if (r->fd < 0)
+        {
+            return false;
+        }
+
+        if (fstat (r->fd, &st) != 0)
+        {
+            close (r->fd);
+            return false;
+        }
+        len = (long) st.st_size;
+    }
+    else
+#endif
+    {
+        r->fp = fopen (path, "rb");
+        if (!r->fp)
+        {
+            return false;
+        }
+
+        fseek (r->fp, 0, SEEK_END);
+        len = ftell (r->fp);
+        fseek (r->fp, 0, SEEK_SET);
+        if (len < 0)
+        {
+            fclose (r->fp);
+            return false;
+        }
+    }
+
+    r->len = (size_t) len;
+    r->data = malloc (r->len ? r->len : 1);
+    ASSERT (r->data != NULL);
+    SDL_AtomicSet (&r->status, AIO_PENDING);
+
+#ifdef AIO_HAVE_URING
+    if (a->backend == AIO_URING)
+    {
+        if (r->len == 0)
+        {
+            close (r->fd);
+            _aio_finish (r, true);
+        }
+        else
+        {
+            _aio_uring_queue (r);
+        }
+
+        return true;
+    }
+#endif
+
+    r->job.run = _aio_read_job;
+    r->job.data = r;
+    workers_submit (&r->job);
+
+    return true;
+}
+
+/* Hands everything queued so far to the kernel in one go */
+static void
+aio_submit (void)
+{
+#ifdef AIO_HAVE_URING
+    if (g__aio.backend == AIO_URING)
+    {
+        _aio_uring_submit (0);
+    }
+#endif
+}
+
+/* Non-blocking, true once the request is done or failed */
+static bool
+aio_poll (struct aio_request *r)
+{
+    if (SDL_AtomicGet (&r->status) != AIO_PENDING)
+    {
+        return true;
+    }
+
+#ifdef AIO_HAVE_URING
+    if (g__aio.backend == AIO_URING)
+    {
+        aio_submit ();
+        _aio_uring_reap ();
+        return SDL_AtomicGet (&r->status) != AIO_PENDING;
+    }
+#endif
+
+    if (job_done (&r->job))
+    {
+        _aio_finish (r, r->read == r->len);
+        return true;
+    }
+
+    return false;
+}
+
+/* Blocks until the request is done, false if it failed */
+static bool
+aio_wait (struct aio_request *r)
+{
+    struct aio *a = &g__aio;
+    Uint64 start = SDL_GetPerformanceCounter ();
+
+    while (!aio_poll (r))
+    {
+#ifdef AIO_HAVE_URING
+        if (a->backend == AIO_URING)
+        {
+            _aio_uring_submit (1);
+            continue;
+        }
+#endif
+        job_wait (&r->job);
+    }
+
+    a->wait_ms += (SDL_GetPerformanceCounter () - start) * 1000.0 / SDL_GetPerformanceFrequency ();
+
+    return SDL_AtomicGet (&r->status) == AIO_DONE;
+}
+
+/* Frees the buffer, the request must be done */
+static void
+aio_release (struct aio_request *r)
+{
+    free (r->data);
+    r->data = NULL;
+}
+
+static void
+aio_shutdown (void)
+{
+    struct aio *a = &g__aio;
+
+    if (!a->initialised)
+    {
+        return;
+    }
+
+    printf ("Async I/O (%s): %u reads, %llu bytes, %u failed, %.2f ms spent waiting\n",
+            _aio_backend_name (a->backend), a->reads, a->bytes, a->failed, a->wait_ms);
+
+#ifdef AIO_HAVE_URING
+    if (a->backend == AIO_URING)
+    {
+        close (a->ring_fd);
+    }
+#endif
+
+    a->initialised = false;
+}
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef _ASSETS_
+#define _ASSETS_
+
+#include <sys/stat.h>
+
+/**
+ * Asset lookup by name.
+ *
+ * Names are resolved in order through:
+ *   - an override directory, only with --assets, so files can still be
+ *     edited without rebuilding. A file that is in it but can't be read
+ *     fails rather than quietly loading a stale built-in copy, and one
+ *     that isn't in it says where it came from instead
+ *   - the asset pack (pack.h), if one was opened
+ *   - shaders and small textures compiled into the executable by the
+ *     build (tools/embed.c -> assets.gen.h, with -DASSETS_EMBEDDED)
+ *   - loose files in the working directory
+ *
+ * asset_prefetch() starts the reads for a list of names up front (aio.h)
+ * so they overlap; asset_open() then only waits for the one it needs.
+ *
+ * Only the pack is mapped; loose and override files are read into a
+ * copy (fileview.h) since they can change under us. Either way asset
+ * data is not terminated: always go by `len`.
+ */
+
+struct embedded_asset
+{
+    const char *name;
+    const unsigned char *data;
+    size_t len;
+};
+
+#ifdef ASSETS_EMBEDDED
+#include "assets.gen.h"
+#else
+static const struct embedded_asset g__embedded_assets[] = {
+    { NULL, NULL, 0 }
+};
+#endif
+
+enum asset_source
+{
+    ASSET_NONE = 0,
+    ASSET_OVERRIDE,     // override directory
+    ASSET_PACK,
+    ASSET_EMBEDDED,
+    ASSET_FILE,         // loose file in the working directory
+    ASSET_SOURCE_MAX
+};
+
+#define ASSET_MAX_PREFETCH 32
+
+struct asset_prefetch
+{
+    char name[32];
+    enum asset_source source;   // ASSET_NONE once claimed
+    struct aio_request request;
+};
+
+struct asset
+{
+    const char *data;
+    size_t len;
+    enum asset_source source;
+    struct file_view view;  // ASSET_OVERRIDE and ASSET_FILE
+    const struct pack_entry *pack;  // ASSET_PACK, a texture's data is a pack_texture
+    struct asset_prefetch *prefetch;
+};
+
+struct asset_stats
+{
+    unsigned int opened[ASSET_SOURCE_MAX];
+    unsigned long bytes[ASSET_SOURCE_MAX];
+};
+
+static const char *g__asset_source_names[ASSET_SOURCE_MAX] = { "none", "override", "packed", "embedded", "loose" };
+
+static char g__asset_dir[256];
+static struct asset_stats g__asset_stats;
+static struct asset_prefetch g__asset_prefetch[ASSET_MAX_PREFETCH];
+static int g__asset_prefetch_count;
+
+static void
+asset_init (const char *override_dir)
+{
+    g__asset_dir[0] = '\0';
+
+    if (override_dir)
+    {
+        snprintf (g__asset_dir, sizeof (g__asset_dir), "%s", override_dir);
+    }
+}
+
+static const char *
+asset_override_dir (void)
+{
+    return g__asset_dir[0] ? g__asset_dir : NULL;
+}
+
+static int
+_asset_compare_embedded (const void *key, const void *entry)
+{
+    return strcmp (key, ((const struct embedded_asset *) entry)->name);
+}
+
+/* tools/embed.c sorts the table by name, the NULL entry at the end isn't searched */
+static const struct embedded_asset *
+_asset_find_embedded (const char *name)
+{
+    return bsearch (name, g__embedded_assets, LEN (g__embedded_assets) - 1, sizeof (g__embedded_assets[0]),
+                    _asset_compare_embedded);
+}
+
+/* Read, not mapped: these are files an editor may be rewriting as we go */
+static bool
+_asset_read_file (const char *path, struct asset *a)
+{
+    if (!file_view_read (path, &a->view))
+    {
+        return false;
+    }
+
+    a->data = a->view.data;
+    a->len = a->view.len;
+
+    return true;
+}
+
+/**
+ * Starts reading every named asset that will come from a file, all in
+ * one batch. Packed ones just get their pages read ahead and embedded
+ * ones need nothing.
+ */
+static void
+asset_prefetch (const char **names, int count)
+{
+    for (int i = 0; i < count && g__asset_prefetch_count < ASSET_MAX_PREFETCH; i++)
+    {
+        struct asset_prefetch *p = &g__asset_prefetch[g__asset_prefetch_count];
+        const struct pack_entry *e;
+
+        snprintf (p->name, sizeof (p->name), "%s", names[i]);
+        p->source = ASSET_NONE;
+
+        if (g__asset_dir[0])
+        {
+            char path[320];
+
+            snprintf (path, sizeof (path), "%s/%s", g__asset_dir, names[i]);
+            if (aio_read (&p->request, path))
+            {
+                p->source = ASSET_OVERRIDE;
+            }
+        }
+
+        if (!p->source && (e = pack_find (names[i])))
+        {
+            pack_prefetch (e);
+            continue;
+        }
+
+        if (!p->source && _asset_find_embedded (names[i]))
+        {
+            continue;
+        }
+
+        if (!p->source && aio_read (&p->request, names[i]))
+        {
+            p->source = ASSET_FILE;
+        }
+
+        if (p->source)
+        {
+            g__asset_prefetch_count++;
+        }
+    }
+
+    aio_submit ();
+}
+
+static bool
+_asset_claim_prefetch (const char *name, struct asset *a)
+{
+    for (int i = 0; i < g__asset_prefetch_count; i++)
+    {
+        struct asset_prefetch *p = &g__asset_prefetch[i];
+
+        if (p->source == ASSET_NONE || strcmp (p->name, name) != 0)
+        {
+            continue;
+        }
+
+        a->source = p->source;
+        p->source = ASSET_NONE;
+
+        if (!aio_wait (&p->request))
+        {
+            LOG_ERROR ("Prefetch of '%s' failed", name);
+            a->source = ASSET_NONE;
+            return false;
+        }
+
+        a->data = p->request.data;
+        a->len = p->request.len;
+        a->prefetch = p;
+
+        return true;
+    }
+
+    return false;
+}
+
+/* Returns false if the asset can't be found anywhere */
+static bool
+asset_open (const char *name, struct asset *a)
+{
+    const struct embedded_asset *e;
+    const struct pack_entry *p;
+    bool not_overridden = false;
+
+    memset (a, 0, sizeof (*a));
+
+    /* only the first open of a prefetched name, later ones map it again */
+    if (_asset_claim_prefetch (name, a))
+    {
+        /* counted below */
+    }
+    else if (g__asset_dir[0])
+    {
+        char path[320];
+        struct stat st;
+
+        snprintf (path, sizeof (path), "%s/%s", g__asset_dir, name);
+        if (_asset_read_file (path, a))
+        {
+            a->source = ASSET_OVERRIDE;
+        }
+        else if (stat (path, &st) == 0)
+        {
+            LOG_ERROR ("Failed to read '%s'", path);
+            return false;
+        }
+        else
+        {
+            not_overridden = true;
+        }
+    }
+
+    if (!a->source && (p = pack_find (name)))
+    {
+        a->data = pack_data (p);
+        a->len = p->size;
+        a->pack = p;
+        a->source = ASSET_PACK;
+    }
+
+    if (!a->source && (e = _asset_find_embedded (name)))
+    {
+        a->data = (const char *) e->data;
+        a->len = e->len;
+        a->source = ASSET_EMBEDDED;
+    }
+
+    if (!a->source && _asset_read_file (name, a))
+    {
+        a->source = ASSET_FILE;
+    }
+
+    if (!a->source)
+    {
+        LOG_ERROR ("Asset '%s' not found", name);
+        return false;
+    }
+
+    if (not_overridden)
+    {
+        printf ("Asset '%s' isn't in '%s', using the %s copy\n", name, g__asset_dir, g__asset_source_names[a->source]);
+    }
+
+    g__asset_stats.opened[a->source]++;
+    g__asset_stats.bytes[a->source] += a->len;
+
+    return true;
+}
+
+static void
+asset_close (struct asset *a)
+{
+    if (a->prefetch)
+    {
+        aio_release (&a->prefetch->request);
+    }
+    else if (a->source == ASSET_OVERRIDE || a->source == ASSET_FILE)
+    {
+        file_view_close (&a->view);
+    }
+
+    memset (a, 0, sizeof (*a));
+}
+
+/* Drops prefetched data nobody opened */
+static void
+asset_shutdown (void)
+{
+    for (int i = 0; i < g__asset_prefetch_count; i++)
+    {
+        struct asset_prefetch *p = &g__asset_prefetch[i];
+
+        if (p->source != ASSET_NONE)
+        {
+            aio_wait (&p->request);
+            aio_release (&p->request);
+            p->source = ASSET_NONE;
+        }
+    }
+
+    g__asset_prefetch_count = 0;
+}
+
+static void
+asset_report (void)
+{
+    struct asset_stats *s = &g__asset_stats;
+
+    printf ("Assets: pack=%u (%lu bytes) embedded=%u (%lu bytes) override=%u (%lu bytes) files=%u (%lu bytes)\n",
+            s->opened[ASSET_PACK], s->bytes[ASSET_PACK],
+            s->opened[ASSET_EMBEDDED], s->bytes[ASSET_EMBEDDED],
+            s->opened[ASSET_OVERRIDE], s->bytes[ASSET_OVERRIDE],
+            s->opened[ASSET_FILE], s->bytes[ASSET_FILE]);
+}
+
+#endif
@@ -0,0 +1,382 @@
+#ifndef _BC_
+#define _BC_
+
+/**
+ * BC1 (DXT1) and BC3 (DXT5) block compression of RGBA8 images, shared by
+ * tools/pack.c and the runtime.
+ *
+ * Each 4x4 block gets two opposite corners of its colour bounding box,
+ * pulled in by 1/16 of the range, as endpoints and every pixel the
+ * nearest of the four palette entries; BC3 adds the alpha range with
+ * eight steps. Of the box's four diagonals the one the colours run along
+ * is picked by the sign of each channel's covariance with the widest
+ * one, so a block going from red to green isn't encoded as black to
+ * yellow. It
+ * is a fast encoder rather than a best-quality one. The bounding box
+ * search is SSE2 where available. Blocks past the edge of an image that isn't a
+ * multiple of 4 repeat the last row/column. bc_decode() expands blocks
+ * back to RGBA8 for drivers without S3TC.
+ */
+
+#include "mips.h"       // MIPS_X86 and the intrinsics
+
+#define BC1_BLOCK_BYTES 8
+#define BC3_BLOCK_BYTES 16
+
+static inline size_t
+bc_level_size (int w, int h, int block_bytes)
+{
+    return (size_t) ((w + 3) / 4) * ((h + 3) / 4) * block_bytes;
+}
+
+/* True if any pixel isn't fully opaque, then it wants BC3 */
+static inline bool
+bc_has_alpha (const unsigned char *rgba, int w, int h)
+{
+    for (size_t i = 0; i < (size_t) w * h; i++)
+    {
+        if (rgba[i * 4 + 3] != 255)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static inline void
+_bc_bounds (const unsigned char block[64], unsigned char lo[4], unsigned char hi[4])
+{
+#ifdef MIPS_X86
+    __m128i mn = _mm_loadu_si128 ((const __m128i *) block);
+    __m128i mx = mn;
+
+    for (int i = 1; i < 4; i++)
+    {
+        __m128i row = _mm_loadu_si128 ((const __m128i *) (block + i * 16));
+
+        mn = _mm_min_epu8 (mn, row);
+        mx = _mm_max_epu8 (mx, row);
+    }
+
+    /* 4 pixels per register, fold them into the first */
+    mn = _mm_min_epu8 (mn, _mm_srli_si128 (mn, 8));
+    mx = _mm_max_epu8 (mx, _mm_srli_si128 (mx, 8));
+    mn = _mm_min_epu8 (mn, _mm_srli_si128 (mn, 4));
+    mx = _mm_max_epu8 (mx, _mm_srli_si128 (mx, 4));
+
+    {
+        uint32_t l = (uint32_t) _mm_cvtsi128_si32 (mn);
+        uint32_t h = (uint32_t) _mm_cvtsi128_si32 (mx);
+
+        memcpy (lo, &l, 4);
+        memcpy (hi, &h, 4);
+    }
+#else
+    memcpy (lo, block, 4);
+    memcpy (hi, block, 4);
+
+    for (int i = 1; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            if (block[i * 4 + c] < lo[c]) lo[c] = block[i * 4 + c];
+            if (block[i * 4 + c] > hi[c]) hi[c] = block[i * 4 + c];
+        }
+    }
+#endif
+}
+
+static inline uint16_t
+_bc_565 (const unsigned char *c)
+{
+    return (uint16_t) (((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+}
+
+static inline void
+_bc_565_rgb (uint16_t v, int *c)
+{
+    c[0] = ((v >> 11) & 31) * 255 / 31;
+    c[1] = ((v >> 5) & 63) * 255 / 63;
+    c[2] = (v & 31) * 255 / 31;
+}
+
+/* Flips the endpoints of each channel that runs against the widest one */
+static inline void
+_bc_select_diagonal (const unsigned char block[64], const unsigned char lo[4], const unsigned char hi[4],
+                     unsigned char a[3], unsigned char b[3])
+{
+    int axis = 0;
+    int cov[3] = { 0, 0, 0 };
+
+    for (int c = 1; c < 3; c++)
+    {
+        if (hi[c] - lo[c] > hi[axis] - lo[axis]) axis = c;
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        const unsigned char *p = block + i * 4;
+        int t[3];
+
+        /* twice the offset from the box centre, keeps it integral */
+        for (int c = 0; c < 3; c++)
+        {
+            t[c] = 2 * p[c] - lo[c] - hi[c];
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            cov[c] += t[c] * t[axis];
+        }
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        if (cov[c] < 0)
+        {
+            unsigned char swap = a[c];
+
+            a[c] = b[c];
+            b[c] = swap;
+        }
+    }
+}
+
+/* The colour part of both formats; four-colour mode, so c0 > c1 unless the block is flat */
+static inline void
+_bc_encode_colour (const unsigned char block[64], const unsigned char lo[4], const unsigned char hi[4],
+                   unsigned char out[8])
+{
+    unsigned char a[3];
+    unsigned char b[3];
+    uint16_t c0;
+    uint16_t c1;
+    int palette[4][3];
+    uint32_t indices = 0;
+
+    for (int c = 0; c < 3; c++)
+    {
+        int inset = (hi[c] - lo[c]) >> 4;
+
+        a[c] = (unsigned char) (hi[c] - inset);
+        b[c] = (unsigned char) (lo[c] + inset);
+    }
+
+    _bc_select_diagonal (block, lo, hi, a, b);
+
+    c0 = _bc_565 (a);
+    c1 = _bc_565 (b);
+    if (c0 < c1)
+    {
+        uint16_t t = c0;
+
+        c0 = c1;
+        c1 = t;
+    }
+
+    if (c0 != c1)
+    {
+        _bc_565_rgb (c0, palette[0]);
+        _bc_565_rgb (c1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            const unsigned char *p = block + i * 4;
+            int best = 0;
+            int best_d = 1 << 30;
+
+            for (int j = 0; j < 4; j++)
+            {
+                int dr = p[0] - palette[j][0];
+                int dg = p[1] - palette[j][1];
+                int db = p[2] - palette[j][2];
+                int d = dr * dr + dg * dg + db * db;
+
+                if (d < best_d)
+                {
+                    best_d = d;
+                    best = j;
+                }
+            }
+
+            indices |= (uint32_t) best << (i * 2);
+        }
+    }
+
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    out[4] = indices & 0xff;
+    out[5] = (indices >> 8) & 0xff;
+    out[6] = (indices >> 16) & 0xff;
+    out[7] = indices >> 24;
+}
+
+static inline void
+_bc_encode_alpha (const unsigned char block[64], unsigned char a0, unsigned char a1, unsigned char out[8])
+{
+    int palette[8];
+    uint64_t indices = 0;
+
+    out[0] = a0;
+    out[1] = a1;
+
+    if (a0 > a1)
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        for (int j = 1; j < 7; j++)
+        {
+            palette[j + 1] = ((7 - j) * a0 + j * a1) / 7;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int alpha = block[i * 4 + 3];
+            int best = 0;
+            int best_d = 256;
+
+            for (int j = 0; j < 8; j++)
+            {
+                int d = abs (alpha - palette[j]);
+
+                if (d < best_d)
+                {
+                    best_d = d;
+                    best = j;
+                }
+            }
+
+            indices |= (uint64_t) best << (i * 3);
+        }
+    }
+
+    for (int i = 0; i < 6; i++)
+    {
+        out[2 + i] = (unsigned char) (indices >> (i * 8));
+    }
+}
+
+/* 4x4 block at (bx, by), clamped to the image */
+static inline void
+_bc_fetch (const unsigned char *rgba, int w, int h, int bx, int by, unsigned char block[64])
+{
+    for (int y = 0; y < 4; y++)
+    {
+        const unsigned char *row = rgba + (size_t) (by + y < h ? by + y : h - 1) * w * 4;
+
+        for (int x = 0; x < 4; x++)
+        {
+            memcpy (block + (y * 4 + x) * 4, row + (bx + x < w ? bx + x : w - 1) * 4, 4);
+        }
+    }
+}
+
+/* out must hold bc_level_size(w, h, block_bytes); block_bytes picks BC1 or BC3 */
+static inline void
+bc_encode (const unsigned char *rgba, int w, int h, int block_bytes, unsigned char *out)
+{
+    unsigned char block[64];
+    unsigned char lo[4];
+    unsigned char hi[4];
+
+    for (int by = 0; by < h; by += 4)
+    {
+        for (int bx = 0; bx < w; bx += 4)
+        {
+            _bc_fetch (rgba, w, h, bx, by, block);
+            _bc_bounds (block, lo, hi);
+
+            if (block_bytes == BC3_BLOCK_BYTES)
+            {
+                _bc_encode_alpha (block, hi[3], lo[3], out);
+                out += 8;
+            }
+
+            _bc_encode_colour (block, lo, hi, out);
+            out += 8;
+        }
+    }
+}
+
+/* The reverse, for when the GL can't take the blocks as they are */
+static inline void
+bc_decode (const unsigned char *in, int w, int h, int block_bytes, unsigned char *rgba)
+{
+    for (int by = 0; by < h; by += 4)
+    {
+        for (int bx = 0; bx < w; bx += 4)
+        {
+            int alpha[8] = { 255, 255, 255, 255, 255, 255, 255, 255 };
+            uint64_t alpha_indices = 0;
+            int palette[4][3];
+            uint16_t c0;
+            uint16_t c1;
+            uint32_t indices;
+
+            if (block_bytes == BC3_BLOCK_BYTES)
+            {
+                alpha[0] = in[0];
+                alpha[1] = in[1];
+                for (int j = 1; j < 7; j++)
+                {
+                    alpha[j + 1] = in[0] > in[1] ? ((7 - j) * in[0] + j * in[1]) / 7
+                                 : j < 5 ? ((5 - j) * in[0] + j * in[1]) / 5 : (j == 5 ? 0 : 255);
+                }
+                for (int i = 0; i < 6; i++)
+                {
+                    alpha_indices |= (uint64_t) in[2 + i] << (i * 8);
+                }
+                in += 8;
+            }
+
+            c0 = (uint16_t) (in[0] | in[1] << 8);
+            c1 = (uint16_t) (in[2] | in[3] << 8);
+            indices = (uint32_t) in[4] | (uint32_t) in[5] << 8 | (uint32_t) in[6] << 16 | (uint32_t) in[7] << 24;
+            in += 8;
+
+            _bc_565_rgb (c0, palette[0]);
+            _bc_565_rgb (c1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+
+                /* BC1's three-colour mode, index 3 is transparent black */
+                if (block_bytes == BC1_BLOCK_BYTES && c0 <= c1)
+                {
+                    palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                    palette[3][c] = 0;
+                }
+            }
+
+            for (int i = 0; i < 16; i++)
+            {
+                int x = bx + i % 4;
+                int y = by + i / 4;
+                unsigned char *p;
+                int j = (indices >> (i * 2)) & 3;
+
+                if (x >= w || y >= h)
+                {
+                    continue;
+                }
+
+                p = rgba + ((size_t) y * w + x) * 4;
+                p[0] = (unsigned char) palette[j][0];
+                p[1] = (unsigned char) palette[j][1];
+                p[2] = (unsigned char) palette[j][2];
+                p[3] = (unsigned char) alpha[(alpha_indices >> (i * 3)) & 7];
+                if (block_bytes == BC1_BLOCK_BYTES && c0 <= c1 && j == 3) p[3] = 0;
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef _BENCH_
+#define _BENCH_
+
+/**
+ * Benchmark results: per-scene CPU frame times and draw-call counts,
+ * summarised as percentiles and written out as a table or as JSON.
+ */
+
+#define BENCH_WARMUP_FRAMES 10
+
+struct bench_result
+{
+    char name[32];
+    int frames;
+    double *frame_ms;
+    unsigned long draw_calls;
+    unsigned long state_calls;          // state changes sent to GL
+    unsigned long state_calls_skipped;  // redundant ones the state cache dropped
+
+    /* stress scenes only, means per frame */
+    int objects;
+    double update_ms;
+    double cull_ms;
+    double submit_ms;
+    unsigned long visible;
+
+    /* filled in by bench_summarise() */
+    double p50_ms;
+    double p95_ms;
+    double p99_ms;
+    double max_ms;
+    double mean_ms;
+};
+
+static int
+_bench_compare_ms (const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile, expects sorted samples */
+static double
+bench_percentile (double *sorted, int count, double pct)
+{
+    int rank;
+
+    if (count == 0)
+    {
+        return 0.0;
+    }
+
+    rank = (int) ceil ((pct / 100.0) * count) - 1;
+    if (rank < 0) rank = 0;
+    if (rank >= count) rank = count - 1;
+
+    return sorted[rank];
+}
+
+static void
+bench_summarise (struct bench_result *r)
+{
+    double sum = 0.0;
+
+    qsort (r->frame_ms, r->frames, sizeof (double), _bench_compare_ms);
+
+    for (int i = 0; i < r->frames; i++)
+    {
+        sum += r->frame_ms[i];
+    }
+
+    r->p50_ms = bench_percentile (r->frame_ms, r->frames, 50.0);
+    r->p95_ms = bench_percentile (r->frame_ms, r->frames, 95.0);
+    r->p99_ms = bench_percentile (r->frame_ms, r->frames, 99.0);
+    r->max_ms = r->frames ? r->frame_ms[r->frames - 1] : 0.0;
+    r->mean_ms = r->frames ? sum / r->frames : 0.0;
+}
+
+static void
+bench_print (struct bench_result *results, int count)
+{
+    printf ("%-16s %8s %9s %9s %9s %9s %11s %11s %11s\n",
+            "scene", "frames", "p50 ms", "p95 ms", "p99 ms", "max ms", "draws/frame", "state/frame", "skip/frame");
+
+    for (int i = 0; i < count; i++)
+    {
+        struct bench_result *r = &results[i];
+        double frames = r->frames ? r->frames : 1;
+
+        printf ("%-16s %8d %9.3f %9.3f %9.3f %9.3f %11.1f %11.1f %11.1f\n",
+                r->name, r->frames, r->p50_ms, r->p95_ms, r->p99_ms, r->max_ms,
+                r->draw_calls / frames, r->state_calls / frames, r->state_calls_skipped / frames);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        struct bench_result *r = &results[i];
+
+        if (r->objects > 0)
+        {
+            printf ("%-16s update=%.3f cull=%.3f submit=%.3f ms/frame, visible=%lu/%d\n",
+                    r->name, r->update_ms, r->cull_ms, r->submit_ms, r->visible, r->objects);
+        }
+    }
+}
+
+static void
+bench_write_json (FILE *fp, struct bench_result *results, int count, double startup_ms, uint64_t texture_bytes)
+{
+    fprintf (fp, "{\n");
+    fprintf (fp, "  \"renderer\": \"%s\",\n", glGetString (GL_RENDERER));
+    fprintf (fp, "  \"version\": \"%s\",\n", glGetString (GL_VERSION));
+    fprintf (fp, "  \"startup_ms\": %.3f,\n", startup_ms);
+    fprintf (fp, "  \"texture_vram_bytes\": %llu,\n", (unsigned long long) texture_bytes);
+    fprintf (fp, "  \"scenes\": [\n");
+
+    for (int i = 0; i < count; i++)
+    {
+        struct bench_result *r = &results[i];
+
+        fprintf (fp, "    { \"name\": \"%s\", \"frames\": %d, "
+                 "\"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f, \"mean_ms\": %.4f, "
+                 "\"draw_calls\": %lu, \"draw_calls_per_frame\": %.2f, "
+                 "\"state_calls\": %lu, \"state_calls_skipped\": %lu",
+                 r->name, r->frames, r->p50_ms, r->p95_ms, r->p99_ms, r->max_ms, r->mean_ms,
+                 r->draw_calls, r->frames ? (double) r->draw_calls / r->frames : 0.0,
+                 r->state_calls, r->state_calls_skipped);
+
+        if (r->objects > 0)
+        {
+            fprintf (fp, ", \"objects\": %d, \"visible\": %lu, \"update_ms\": %.4f, \"cull_ms\": %.4f, \"submit_ms\": %.4f",
+                     r->objects, r->visible, r->update_ms, r->cull_ms, r->submit_ms);
+        }
+
+        fprintf (fp, " }%s\n", i + 1 < count ? "," : "");
+    }
+
+    fprintf (fp, "  ]\n");
+    fprintf (fp, "}\n");
+}
+
+#endif
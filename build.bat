@@ -7,8 +7,21 @@ if not defined MSVC_HOST (
 if not exist SDL2.dll call sdl.bat
 if not exist glew32.dll call glew.bat
 
+rem -DDEBUG: glGetError after every GL call
+rem -DPROFILE: one glGetError per frame
+rem neither: release, KHR_debug callback only
 set defines=-DDEBUG
 
+rem Shaders and small textures are compiled in (see assets.h)
+set assets=square.vs square.fs tri.vs tri.fs tex.vs tex.fs cube.vs camera.glsl bricks.jpg face.png
+cl /nologo tools\embed.c /Fe:tools\embed.exe /Fo:tools\ || exit /b 1
+tools\embed.exe assets.gen.h %assets% || exit /b 1
+set defines=%defines% -DASSETS_EMBEDDED
+
+rem ...and everything, textures pre-decoded with mips and block compressed, goes in the pack
+cl /nologo /I include tools\pack.c /Fe:tools\pack.exe /Fo:tools\ || exit /b 1
+tools\pack.exe -bc assets.pack %assets% || exit /b 1
+
 set libs=Shell32.lib SDL2.lib SDL2main.lib glew32.lib glew32s.lib OpenGL32.lib
 set cflags=%defines% /I include
 set ldflags=/link /subsystem:console /libpath:lib\x64 %libs%
@@ -0,0 +1,24 @@
+#!/bin/sh
+
+# Linux build. Needs the SDL2 and GLEW development packages.
+
+# -DDEBUG: glGetError after every GL call
+# -DPROFILE: one glGetError per frame
+# neither: release, KHR_debug callback only
+defines=-DDEBUG
+
+# Shaders and small textures are compiled in (see assets.h)
+assets="*.vs *.fs *.glsl bricks.jpg face.png"
+cc tools/embed.c -o tools/embed && tools/embed assets.gen.h $assets || exit 1
+defines="$defines -DASSETS_EMBEDDED"
+
+# ...and everything, textures pre-decoded with mips and block compressed, goes in the pack
+cc -I include tools/pack.c -o tools/pack -lm && tools/pack -bc assets.pack $assets || exit 1
+
+libs="$(sdl2-config --libs) -lGLEW -lGL -lm"
+cflags="$defines -I include $(sdl2-config --cflags) -rdynamic"
+source=main.c
+
+cc $cflags $source -o main $libs
+
+if command -v ctags > /dev/null; then ctags -R .; fi
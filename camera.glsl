@@ -0,0 +1,7 @@
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 time;
+} camera;
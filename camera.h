@@ -0,0 +1,76 @@
+#ifndef _CAMERA_
+#define _CAMERA_
+
+/**
+ * Per-frame camera data shared by every program through a std140
+ * uniform block ("Camera") at a fixed binding point. The buffer is
+ * orphaned and rewritten once per frame, so the driver never has to wait
+ * for the previous frame's draws before accepting the new contents.
+ */
+
+#define CAMERA_BINDING 0
+#define CAMERA_BLOCK   "Camera"
+
+/* Must match the Camera block in the shaders (std140) */
+struct camera_block
+{
+    mat4_t view;
+    mat4_t projection;
+    mat4_t view_projection;
+    float time[4];  // x = seconds, y = delta seconds
+};
+
+struct camera
+{
+    unsigned int ubo;
+    struct camera_block block;
+    unsigned long uploads;
+};
+
+static struct camera g__camera;
+
+static void
+camera_init (void)
+{
+    struct camera *c = &g__camera;
+
+    ASSERT (sizeof (struct camera_block) == 3 * 64 + 16);
+
+    GLCALL (glGenBuffers (1, &c->ubo));
+    GLCALL (glBindBuffer (GL_UNIFORM_BUFFER, c->ubo));
+    GLCALL (glBufferData (GL_UNIFORM_BUFFER, sizeof (struct camera_block), NULL, GL_STREAM_DRAW));
+    GLCALL (glBindBufferBase (GL_UNIFORM_BUFFER, CAMERA_BINDING, c->ubo));
+}
+
+/* Hook a linked program's Camera block (if it has one) up to the binding point */
+static void
+camera_bind_program (unsigned int program_id)
+{
+    unsigned int index;
+
+    GLCALL (index = glGetUniformBlockIndex (program_id, CAMERA_BLOCK));
+    if (index != GL_INVALID_INDEX)
+    {
+        GLCALL (glUniformBlockBinding (program_id, index, CAMERA_BINDING));
+    }
+}
+
+/* Call once per frame, before any draws */
+static void
+camera_update (mat4_t *view, mat4_t *projection, struct frame_clock *clock)
+{
+    struct camera *c = &g__camera;
+
+    c->block.view = *view;
+    c->block.projection = *projection;
+    c->block.view_projection = m4_mul (*projection, *view);
+    c->block.time[0] = clock->secs;
+    c->block.time[1] = clock->dt;
+
+    GLCALL (glBindBuffer (GL_UNIFORM_BUFFER, c->ubo));
+    GLCALL (glBufferData (GL_UNIFORM_BUFFER, sizeof (struct camera_block), NULL, GL_STREAM_DRAW));
+    GLCALL (glBufferSubData (GL_UNIFORM_BUFFER, 0, sizeof (struct camera_block), &c->block));
+    c->uploads++;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#version 330 core
+
+layout (location=0) in vec3 pos;
+layout (location=1) in vec2 coords;
+#ifdef INSTANCED
+layout (location=2) in mat4 i_model;    // per instance, takes locations 2-5
+#endif
+
+out vec2 vert_tex_coords;
+
+#include "camera.glsl"
+
+#ifndef INSTANCED
+uniform mat4 u_model;
+#endif
+
+void main()
+{
+#ifdef INSTANCED
+    gl_Position = camera.view_projection * i_model * vec4(pos, 1.0);
+#else
+    gl_Position = camera.view_projection * u_model * vec4(pos, 1.0);
+#endif
+    vert_tex_coords = coords;
+}
@@ -0,0 +1,234 @@
+#ifndef _FILEVIEW_
+#define _FILEVIEW_
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Read-only view of a whole file, mapped rather than copied.
+ *
+ * The pages are only read in as they are touched and nothing is
+ * duplicated on the heap, so a file that is decoded or compiled straight
+ * from the view is touched once. The data is NOT terminated: always use
+ * `len`. The pointer is valid until file_view_close().
+ *
+ * Files something else may rewrite while we read them (the asset
+ * override directory, which an editor saves into) are opened with
+ * file_view_read() instead: a mapping of a file truncated underneath it
+ * faults (SIGBUS) on access, a copy just holds whatever was read.
+ */
+
+struct file_view
+{
+    const void *data;
+    size_t len;
+    void *copy;         // file_view_read(), freed instead of unmapped
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+/* Empty files can't be mapped, they all share this */
+static const char g__file_view_empty[1];
+
+#ifdef _WIN32
+
+static bool
+file_view_open (const char *path, struct file_view *v)
+{
+    LARGE_INTEGER size;
+
+    memset (v, 0, sizeof (*v));
+
+    v->file = CreateFileA (path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (v->file == INVALID_HANDLE_VALUE)
+    {
+        v->file = NULL;
+        return false;
+    }
+
+    GetFileSizeEx (v->file, &size);
+    v->len = (size_t) size.QuadPart;
+
+    if (v->len == 0)
+    {
+        v->data = g__file_view_empty;
+        return true;
+    }
+
+    v->mapping = CreateFileMappingA (v->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    v->data = v->mapping ? MapViewOfFile (v->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+    if (!v->data)
+    {
+        LOG_ERROR ("Failed to map '%s' (%lu)", path, GetLastError ());
+        if (v->mapping) CloseHandle (v->mapping);
+        CloseHandle (v->file);
+        memset (v, 0, sizeof (*v));
+        return false;
+    }
+
+    return true;
+}
+
+static void
+file_view_close (struct file_view *v)
+{
+    free (v->copy);
+    if (v->mapping)
+    {
+        UnmapViewOfFile (v->data);
+        CloseHandle (v->mapping);
+    }
+    if (v->file)
+    {
+        CloseHandle (v->file);
+    }
+
+    memset (v, 0, sizeof (*v));
+}
+
+/* Asks for a range to be read in ahead of use, without waiting for it */
+static void
+file_view_prefetch (struct file_view *v, size_t offset, size_t len)
+{
+    WIN32_MEMORY_RANGE_ENTRY range;
+
+    if (!v->mapping || offset >= v->len)
+    {
+        return;
+    }
+
+    range.VirtualAddress = (char *) v->data + offset;
+    range.NumberOfBytes = offset + len > v->len ? v->len - offset : len;
+    PrefetchVirtualMemory (GetCurrentProcess (), 1, &range, 0);
+}
+
+#else
+
+static bool
+file_view_open (const char *path, struct file_view *v)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    memset (v, 0, sizeof (*v));
+
+    fd = open (path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (fstat (fd, &st) != 0)
+    {
+        close (fd);
+        return false;
+    }
+
+    v->len = (size_t) st.st_size;
+
+    if (v->len == 0)
+    {
+        v->data = g__file_view_empty;
+        close (fd);
+        return true;
+    }
+
+    /* the mapping keeps its own reference to the file */
+    data = mmap (NULL, v->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+
+    if (data == MAP_FAILED)
+    {
+        LOG_ERROR ("Failed to map '%s'", path);
+        memset (v, 0, sizeof (*v));
+        return false;
+    }
+
+    /* everything is read front to back once: read ahead hard, drop behind */
+    madvise (data, v->len, MADV_SEQUENTIAL);
+    v->data = data;
+
+    return true;
+}
+
+static void
+file_view_close (struct file_view *v)
+{
+    free (v->copy);
+    if (!v->copy && v->data && v->data != g__file_view_empty)
+    {
+        munmap ((void *) v->data, v->len);
+    }
+
+    memset (v, 0, sizeof (*v));
+}
+
+/* Asks for a range to be read in ahead of use, without waiting for it */
+static void
+file_view_prefetch (struct file_view *v, size_t offset, size_t len)
+{
+    size_t page = (size_t) sysconf (_SC_PAGESIZE);
+    size_t start = offset & ~(page - 1);
+
+    if (!v->data || v->copy || v->data == g__file_view_empty || offset >= v->len)
+    {
+        return;
+    }
+
+    if (offset + len > v->len) len = v->len - offset;
+    madvise ((char *) v->data + start, len + (offset - start), MADV_WILLNEED);
+}
+
+#endif
+
+/* Reads the whole file into a heap copy, same interface as file_view_open() */
+static bool
+file_view_read (const char *path, struct file_view *v)
+{
+    FILE *fp;
+    long size;
+
+    memset (v, 0, sizeof (*v));
+
+    fp = fopen (path, "rb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    if (fseek (fp, 0, SEEK_END) != 0 || (size = ftell (fp)) < 0 || fseek (fp, 0, SEEK_SET) != 0)
+    {
+        fclose (fp);
+        return false;
+    }
+
+    if (size == 0)
+    {
+        v->data = g__file_view_empty;
+        fclose (fp);
+        return true;
+    }
+
+    v->copy = malloc ((size_t) size);
+    ASSERT (v->copy != NULL);
+
+    /* the file may shrink while we read it, keep what was there */
+    v->len = fread (v->copy, 1, (size_t) size, fp);
+    v->data = v->copy;
+    fclose (fp);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef _GLSTATE_
+#define _GLSTATE_
+
+/**
+ * Shadow copy of the GL state the render functions touch.
+ *
+ * Render functions declare the state they need (program, VAO, textures,
+ * depth/polygon state, clear colour) through these wrappers and calls
+ * that would not change anything never reach the driver. Only valid on
+ * the thread that owns the GL context. Anything that binds behind the
+ * cache's back (setup code, texture uploads) must call gls_invalidate().
+ */
+
+#define GLS_TEXTURE_UNITS 16
+#define GLS_UNKNOWN       0xFFFFFFFFu
+
+enum gls_call
+{
+    GLS_USE_PROGRAM = 0,
+    GLS_BIND_VERTEX_ARRAY,
+    GLS_ACTIVE_TEXTURE,
+    GLS_BIND_TEXTURE,
+    GLS_DEPTH_TEST,
+    GLS_DEPTH_FUNC,
+    GLS_POLYGON_MODE,
+    GLS_CLEAR_COLOUR,
+    GLS_CALL_MAX
+};
+
+struct gl_state
+{
+    unsigned int program;
+    unsigned int vao;
+    unsigned int active_unit;
+    unsigned int textures[GLS_TEXTURE_UNITS];   // GL_TEXTURE_2D binding per unit
+    unsigned int depth_test;
+    unsigned int depth_func;
+    unsigned int polygon_mode;
+    float clear_colour[4];
+    bool clear_colour_known;
+
+    unsigned long issued[GLS_CALL_MAX];
+    unsigned long skipped[GLS_CALL_MAX];
+};
+
+static struct gl_state g__gl_state;
+
+static char *
+_gls_call_name (enum gls_call call)
+{
+    switch (call)
+    {
+        case GLS_USE_PROGRAM: return "glUseProgram";
+        case GLS_BIND_VERTEX_ARRAY: return "glBindVertexArray";
+        case GLS_ACTIVE_TEXTURE: return "glActiveTexture";
+        case GLS_BIND_TEXTURE: return "glBindTexture";
+        case GLS_DEPTH_TEST: return "glEnable/glDisable(GL_DEPTH_TEST)";
+        case GLS_DEPTH_FUNC: return "glDepthFunc";
+        case GLS_POLYGON_MODE: return "glPolygonMode";
+        case GLS_CLEAR_COLOUR: return "glClearColor";
+        default: return "???";
+    }
+}
+
+/* Forget everything, the next call of each kind goes to the driver */
+static void
+gls_invalidate (void)
+{
+    struct gl_state *s = &g__gl_state;
+
+    s->program = GLS_UNKNOWN;
+    s->vao = GLS_UNKNOWN;
+    s->active_unit = GLS_UNKNOWN;
+    for (int i = 0; i < GLS_TEXTURE_UNITS; i++)
+    {
+        s->textures[i] = GLS_UNKNOWN;
+    }
+    s->depth_test = GLS_UNKNOWN;
+    s->depth_func = GLS_UNKNOWN;
+    s->polygon_mode = GLS_UNKNOWN;
+    s->clear_colour_known = false;
+}
+
+/* Returns true if the call needs to be issued */
+static bool
+_gls_update (enum gls_call call, unsigned int *current, unsigned int value)
+{
+    if (*current == value)
+    {
+        g__gl_state.skipped[call]++;
+        return false;
+    }
+
+    *current = value;
+    g__gl_state.issued[call]++;
+
+    return true;
+}
+
+static void
+gls_use_program (unsigned int program)
+{
+    if (_gls_update (GLS_USE_PROGRAM, &g__gl_state.program, program))
+    {
+        GLCALL (glUseProgram (program));
+    }
+}
+
+static void
+gls_bind_vertex_array (unsigned int vao)
+{
+    if (_gls_update (GLS_BIND_VERTEX_ARRAY, &g__gl_state.vao, vao))
+    {
+        GLCALL (glBindVertexArray (vao));
+    }
+}
+
+static void
+gls_active_texture (unsigned int unit)
+{
+    if (_gls_update (GLS_ACTIVE_TEXTURE, &g__gl_state.active_unit, unit))
+    {
+        GLCALL (glActiveTexture (GL_TEXTURE0 + unit));
+    }
+}
+
+/* Binds a GL_TEXTURE_2D to a unit, only switching units if it has to */
+static void
+gls_bind_texture (unsigned int unit, unsigned int texture)
+{
+    ASSERT (unit < GLS_TEXTURE_UNITS);
+
+    if (g__gl_state.textures[unit] == texture)
+    {
+        g__gl_state.skipped[GLS_BIND_TEXTURE]++;
+        return;
+    }
+
+    gls_active_texture (unit);
+    _gls_update (GLS_BIND_TEXTURE, &g__gl_state.textures[unit], texture);
+    GLCALL (glBindTexture (GL_TEXTURE_2D, texture));
+}
+
+static void
+gls_depth_test (bool enable)
+{
+    if (_gls_update (GLS_DEPTH_TEST, &g__gl_state.depth_test, enable))
+    {
+        if (enable)
+        {
+            GLCALL (glEnable (GL_DEPTH_TEST));
+        }
+        else
+        {
+            GLCALL (glDisable (GL_DEPTH_TEST));
+        }
+    }
+}
+
+static void
+gls_depth_func (unsigned int func)
+{
+    if (_gls_update (GLS_DEPTH_FUNC, &g__gl_state.depth_func, func))
+    {
+        GLCALL (glDepthFunc (func));
+    }
+}
+
+static void
+gls_polygon_mode (unsigned int mode)
+{
+    if (_gls_update (GLS_POLYGON_MODE, &g__gl_state.polygon_mode, mode))
+    {
+        GLCALL (glPolygonMode (GL_FRONT_AND_BACK, mode));
+    }
+}
+
+static void
+gls_clear_colour (float r, float g, float b, float a)
+{
+    struct gl_state *s = &g__gl_state;
+
+    if (s->clear_colour_known &&
+        s->clear_colour[0] == r && s->clear_colour[1] == g &&
+        s->clear_colour[2] == b && s->clear_colour[3] == a)
+    {
+        s->skipped[GLS_CLEAR_COLOUR]++;
+        return;
+    }
+
+    s->clear_colour[0] = r;
+    s->clear_colour[1] = g;
+    s->clear_colour[2] = b;
+    s->clear_colour[3] = a;
+    s->clear_colour_known = true;
+    s->issued[GLS_CLEAR_COLOUR]++;
+
+    GLCALL (glClearColor (r, g, b, a));
+}
+
+static void
+gls_totals (unsigned long *issued, unsigned long *skipped)
+{
+    *issued = 0;
+    *skipped = 0;
+
+    for (int i = 0; i < GLS_CALL_MAX; i++)
+    {
+        *issued += g__gl_state.issued[i];
+        *skipped += g__gl_state.skipped[i];
+    }
+}
+
+static void
+gls_report (void)
+{
+    unsigned long issued;
+    unsigned long skipped;
+
+    gls_totals (&issued, &skipped);
+
+    printf ("GL state cache: issued=%lu skipped=%lu\n", issued, skipped);
+    for (int i = 0; i < GLS_CALL_MAX; i++)
+    {
+        printf ("  %-36s issued=%-8lu skipped=%lu\n",
+                _gls_call_name (i), g__gl_state.issued[i], g__gl_state.skipped[i]);
+    }
+}
+
+#endif
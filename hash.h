@@ -0,0 +1,39 @@
+#ifndef _HASH_
+#define _HASH_
+
+#include <stdint.h>
+
+/* FNV-1a, good enough for names and content keys */
+
+#define HASH_FNV64_BASIS 0xcbf29ce484222325ull
+#define HASH_FNV64_PRIME 0x100000001b3ull
+
+static inline uint64_t
+hash_fnv1a (const void *data, size_t len, uint64_t hash)
+{
+    const unsigned char *p = data;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= HASH_FNV64_PRIME;
+    }
+
+    return hash;
+}
+
+static inline uint32_t
+hash_string (const char *str)
+{
+    uint32_t hash = 0x811c9dc5u;
+
+    while (*str)
+    {
+        hash ^= (unsigned char) *str++;
+        hash *= 0x01000193u;
+    }
+
+    return hash;
+}
+
+#endif
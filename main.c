@@ -26,12 +26,87 @@
 #define LEN(arr) (sizeof ((arr)) / sizeof ((arr)[0]))
 #define ASSERT(expr) \
     if (!(expr)) { FATAL ("Assertion failed in %s at %s():%d\n %s", __FILE__, __func__, __LINE__, #expr); *(int *) 0 = 0; }
-#define GLCALL(expr) expr; ASSERT (gl_check_error (#expr, __FILE__, __LINE__))
+#define GLDRAW(expr) GLCALL (expr); g__draw_calls++
 #define RADIANS(__DEGREES) (__DEGREES * (M_PI / 180.0))
 
 #define WINDOW_WIDTH_PX     800
 #define WINDOW_HEIGHT_PX    600
 #define FRAME_TIME_MS       (1000.0f / 30.0f)
+#define BENCH_STEP_SECS     (1.0 / 60.0)
+#define FRAME_QUEUE_LEN     2
+#define CUBE_MAX_INSTANCES  16
+#define STRESS_MAX_COUNTS   8
+#define STRESS_DEFAULT      10000
+#define PROGRAM_SLOTS       10      // variants per render target, next to its own program
+#define PROGRAMS_MAX        (STATE_RENDER_MAX * (1 + PROGRAM_SLOTS))
+
+/**
+ * GL error checking tiers:
+ *   GL_CHECK_CALL   glGetError after every GLCALL (DEBUG builds)
+ *   GL_CHECK_FRAME  one glGetError sweep per pass/frame (PROFILE builds)
+ *   GL_CHECK_NONE   nothing but the KHR_debug callback (release builds)
+ *
+ * In the first two every GLCALL site keeps a hit counter, and the time
+ * spent in glGetError is accumulated, so the cost of checking can be
+ * compared against a release build.
+ */
+#define GL_CHECK_NONE  0
+#define GL_CHECK_FRAME 1
+#define GL_CHECK_CALL  2
+
+#ifndef GL_CHECK_LEVEL
+#if defined (DEBUG)
+#define GL_CHECK_LEVEL GL_CHECK_CALL
+#elif defined (PROFILE)
+#define GL_CHECK_LEVEL GL_CHECK_FRAME
+#else
+#define GL_CHECK_LEVEL GL_CHECK_NONE
+#endif
+#endif
+
+struct gl_site
+{
+    char *expr;
+    char *file;
+    int line;
+    unsigned long hits;
+    struct gl_site *next;
+};
+
+#if GL_CHECK_LEVEL == GL_CHECK_CALL
+#define GLCALL(expr) expr; { static struct gl_site _site = { #expr, __FILE__, __LINE__ }; ASSERT (gl_check_site (&_site)); }
+#define GLCHECK(pass)
+#elif GL_CHECK_LEVEL == GL_CHECK_FRAME
+#define GLCALL(expr) expr; { static struct gl_site _site = { #expr, __FILE__, __LINE__ }; gl_site_hit (&_site); }
+#define GLCHECK(pass) ASSERT (gl_check_pass (pass))
+#else
+#define GLCALL(expr) expr
+#define GLCHECK(pass)
+#endif
+
+static bool gl_check_site (struct gl_site *site);
+static void gl_site_hit (struct gl_site *site);
+static bool gl_check_pass (char *pass);
+
+#include "timing.h"
+#include "bench.h"
+#include "queue.h"
+#include "glstate.h"
+#include "program.h"
+#include "camera.h"
+#include "scene.h"
+#include "fileview.h"
+#include "workers.h"
+#include "progcache.h"
+#include "shadercache.h"
+#include "aio.h"
+#include "pack.h"
+#include "texcache.h"
+#include "pbo.h"
+#include "assets.h"
+#include "texstream.h"
+#include "shaderpp.h"
+#include "watch.h"
 
 enum state
 {
@@ -40,15 +115,77 @@ enum state
     STATE_RENDER_TRIANGLE,
     STATE_RENDER_TEXTURE,
     STATE_RENDER_CUBE,
+    STATE_RENDER_STRESS,
     STATE_RENDER_MAX
 };
 
 struct render_target
 {
     unsigned int vao;
-    unsigned int shader_id;
-    unsigned int shader_ids[10];
+    unsigned int vbo;
+    unsigned int instance_vao;
+    unsigned int instance_vbo;
+    int instance_capacity;
+    mat4_t view;
+    mat4_t projection;
+    struct program program;
+    struct program programs[PROGRAM_SLOTS];
     unsigned int texture_ids[10];
+    struct scene *scene;
+    struct render_target *shared;   // borrows programs and textures from this target
+};
+
+/* Everything the renderer needs to draw one frame, copied per frame */
+struct frame
+{
+    enum state state;
+    int variation;
+    bool rotate;
+    bool draw_wireframes;
+    bool instanced;
+    enum pace_mode pace_mode;
+    struct frame_clock clock;
+    bool bench;             // bench_run collects the stats, no periodic reports
+};
+
+struct render_thread
+{
+    SDL_Thread *thread;
+    struct spsc_queue frames;   // main -> render
+    SDL_sem *frames_queued;     // render thread sleeps on this
+    SDL_sem *frames_free;       // main thread sleeps on this when the queue is full
+    SDL_atomic_t running;
+};
+
+/* Preprocessed sources of a program, produced off the GL thread for hot reloads */
+struct shader_sources
+{
+    char *vertex;
+    char *fragment;
+    size_t vertex_len;
+    size_t fragment_len;
+    uint64_t cache_key;
+};
+
+/* One program being rebuilt, its sources preprocessed by the batch job */
+struct hot_reload_build
+{
+    struct program *target;
+    struct program *next;       // becomes target->reload once the sources are in
+    struct shader_sources sources;
+};
+
+struct hot_reload
+{
+    struct job job;             // preprocesses `builds` on a worker
+    bool busy;
+    int build_count;
+    struct hot_reload_build builds[PROGRAMS_MAX];
+
+    int reloads;
+    int failed;
+    double latency_ms;      // change seen -> new program swapped in, summed
+    double render_ms;       // render thread time spent on reloads, summed
 };
 
 struct context
@@ -56,17 +193,67 @@ struct context
     SDL_Window *window;
     SDL_GLContext *gl;
 
-    enum state state;
-    int variation;
-    bool rotate;
+    struct frame frame;
     struct render_target render_targets[STATE_RENDER_MAX];
 
-    bool draw_wireframes;
+    struct pacer pacer;
+    struct render_thread render_thread;
+
+    struct scene scene;
+    int stress_counts[STRESS_MAX_COUNTS];
+    int stress_count_len;
+
+    struct file_watch watch;
+    struct hot_reload hot_reload;
 };
 
 
 /* Globals */
 static bool g__running;
+static unsigned long g__draw_calls;
+static double g__startup_ms;
+static bool g__parallel_compile;
+
+/**
+ * Everything the *_setup functions load. They take the names from here,
+ * so the batch read before they run can't miss one.
+ */
+enum setup_asset
+{
+    SETUP_SQUARE_VS = 0,
+    SETUP_SQUARE_FS,
+    SETUP_TRI_VS,
+    SETUP_TRI_FS,
+    SETUP_TEX_VS,
+    SETUP_TEX_FS,
+    SETUP_CUBE_VS,
+    SETUP_CAMERA_GLSL,      // only through #include, nothing names it directly
+    SETUP_BRICKS,
+    SETUP_FACE,
+    SETUP_ASSET_MAX
+};
+
+static const char *g__setup_assets[SETUP_ASSET_MAX] = {
+    [SETUP_SQUARE_VS] = "square.vs",
+    [SETUP_SQUARE_FS] = "square.fs",
+    [SETUP_TRI_VS] = "tri.vs",
+    [SETUP_TRI_FS] = "tri.fs",
+    [SETUP_TEX_VS] = "tex.vs",
+    [SETUP_TEX_FS] = "tex.fs",
+    [SETUP_CUBE_VS] = "cube.vs",
+    [SETUP_CAMERA_GLSL] = "camera.glsl",
+    [SETUP_BRICKS] = "bricks.jpg",
+    [SETUP_FACE] = "face.png",
+};
+
+#define SETUP_ASSET(id) (g__setup_assets[SETUP_##id])
+
+/* Texture scene variation -> tex.fs permutation */
+static unsigned int g__texture_variants[] = {
+    0,
+    SHADER_VERTEX_COLOUR,
+    SHADER_TEX_MIX,
+};
 
 
 static bool
@@ -85,6 +272,80 @@ gl_check_error (char *func, char *file, int line)
     return ok;
 }
 
+/* Sites register themselves the first time they are hit */
+static struct gl_site *g__gl_sites;
+static struct gl_site *g__gl_last_site;
+static unsigned long g__gl_checks;
+static Uint64 g__gl_check_ticks;
+
+static void
+gl_site_hit (struct gl_site *site)
+{
+    if (site->hits++ == 0)
+    {
+        site->next = g__gl_sites;
+        g__gl_sites = site;
+    }
+
+    g__gl_last_site = site;
+}
+
+static bool
+gl_check_site (struct gl_site *site)
+{
+    Uint64 start = SDL_GetPerformanceCounter ();
+    bool ok;
+
+    gl_site_hit (site);
+    ok = gl_check_error (site->expr, site->file, site->line);
+
+    g__gl_checks++;
+    g__gl_check_ticks += SDL_GetPerformanceCounter () - start;
+
+    return ok;
+}
+
+/* One sweep for everything since the last check, blames the last site hit */
+static bool
+gl_check_pass (char *pass)
+{
+    Uint64 start = SDL_GetPerformanceCounter ();
+    struct gl_site *site = g__gl_last_site;
+    bool ok;
+
+    ok = gl_check_error (pass, site ? site->file : __FILE__, site ? site->line : __LINE__);
+
+    g__gl_checks++;
+    g__gl_check_ticks += SDL_GetPerformanceCounter () - start;
+
+    return ok;
+}
+
+static void
+gl_sites_report (void)
+{
+    unsigned long hits = 0;
+    int sites = 0;
+
+    for (struct gl_site *site = g__gl_sites; site; site = site->next)
+    {
+        hits += site->hits;
+        sites++;
+    }
+
+    printf ("GL error checks (level %d): sites=%d calls=%lu checks=%lu time=%.3f ms\n",
+            GL_CHECK_LEVEL, sites, hits, g__gl_checks,
+            g__gl_check_ticks * 1000.0 / SDL_GetPerformanceFrequency ());
+
+    for (struct gl_site *site = g__gl_sites; site; site = site->next)
+    {
+        if (site->hits >= 1000)
+        {
+            printf ("  %8lu  %s:%d  %s\n", site->hits, site->file, site->line, site->expr);
+        }
+    }
+}
+
 static char *
 _gl_source (GLenum source)
 {
@@ -153,7 +414,7 @@ _signal_handler (int signal)
 }
 
 static void
-init (struct context *ctx)
+init (struct context *ctx, bool headless)
 {
     ASSERT (signal (SIGINT, _signal_handler) != SIG_ERR);
     ASSERT (signal (SIGSEGV, _signal_handler) != SIG_ERR);
@@ -176,26 +437,47 @@ init (struct context *ctx)
                                     SDL_WINDOWPOS_CENTERED,
                                     WINDOW_WIDTH_PX,
                                     WINDOW_HEIGHT_PX,
-                                    SDL_WINDOW_OPENGL);
+                                    SDL_WINDOW_OPENGL | (headless ? SDL_WINDOW_HIDDEN : 0));
     ASSERT (ctx->window != NULL);
 
     ctx->gl = SDL_GL_CreateContext (ctx->window);
     ASSERT (ctx->gl != NULL);
-    ctx->variation = -1;
-
-    SDL_GL_SetSwapInterval (1); // vsync on
+    ctx->frame.variation = -1;
+    ctx->frame.instanced = true;
 
     ASSERT (glewInit () == GLEW_OK);
 
     glEnable (GL_DEBUG_OUTPUT);
+#if GL_CHECK_LEVEL == GL_CHECK_CALL
+    /* report from inside the offending call so the stack trace is useful */
+    glEnable (GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
     glDebugMessageCallback (_gl_debug_msg_cb, 0);
 
     printf ("Learning OpenGL! (version %s)\n", glGetString (GL_VERSION));
+
+    if (GLEW_KHR_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsKHR (0xFFFFFFFF);
+        g__parallel_compile = true;
+    }
+    else if (GLEW_ARB_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsARB (0xFFFFFFFF);
+        g__parallel_compile = true;
+    }
+    printf ("Parallel shader compile: %s\n", g__parallel_compile ? "yes" : "no");
+
+    pacer_init (&ctx->pacer, headless ? PACE_UNCAPPED : PACE_FIXED, FRAME_TIME_MS);
+    ctx->frame.pace_mode = ctx->pacer.mode;
 }
 
 static void
 cleanup (struct context *ctx)
 {
+    gls_report ();
+    gl_sites_report ();
+
     SDL_GL_DeleteContext (ctx->gl);
     SDL_DestroyWindow (ctx->window);
     SDL_Quit ();
@@ -210,31 +492,41 @@ process_keydown (struct context *ctx, SDL_Keycode key)
             g__running = false;
             break;
         case SDLK_1:
-            ctx->state = STATE_RENDER_SQUARE;
+            ctx->frame.state = STATE_RENDER_SQUARE;
             break;
         case SDLK_2:
-            ctx->state = STATE_RENDER_TRIANGLE;
+            ctx->frame.state = STATE_RENDER_TRIANGLE;
             break;
         case SDLK_3:
-            ctx->state = STATE_RENDER_TEXTURE;
-            ctx->variation++;
-            if (ctx->variation >= 3)
+            ctx->frame.state = STATE_RENDER_TEXTURE;
+            ctx->frame.variation++;
+            if (ctx->frame.variation >= (int) LEN (g__texture_variants))
             {
-                ctx->variation = 0;
+                ctx->frame.variation = 0;
             }
             break;
+        case SDLK_5:
+            ctx->frame.state = STATE_RENDER_STRESS;
+            break;
         case SDLK_w:
-            ctx->draw_wireframes = !ctx->draw_wireframes;
+            ctx->frame.draw_wireframes = !ctx->frame.draw_wireframes;
             break;
         case SDLK_r:
-            ctx->rotate = !ctx->rotate;
+            ctx->frame.rotate = !ctx->frame.rotate;
+            break;
+        case SDLK_i:
+            ctx->frame.instanced = !ctx->frame.instanced;
+            printf ("Instancing %s\n", ctx->frame.instanced ? "on" : "off");
+            break;
+        case SDLK_p:
+            ctx->frame.pace_mode = (ctx->frame.pace_mode + 1) % PACE_MAX;
             break;
         case SDLK_4:
-            ctx->state = STATE_RENDER_CUBE;
-            ctx->variation++;
-            if (ctx->variation >= 9)
+            ctx->frame.state = STATE_RENDER_CUBE;
+            ctx->frame.variation++;
+            if (ctx->frame.variation >= 9)
             {
-                ctx->variation = 0;
+                ctx->frame.variation = 0;
             }
             break;
         default:
@@ -262,65 +554,41 @@ handle_input (struct context *ctx)
     }
 }
 
-/* Must be freed with free() */
-static char *
-read_file_to_buffer (char *file)
+/* Starts compiling a stage (or reuses one), the status is checked when the program is polled */
+static unsigned int
+shader_submit (unsigned int type, const char *source, size_t len, bool *cached)
 {
-    char *buf = NULL;
-    size_t len = 0;
-    FILE *fp;
-
-    printf ("Read File [%s]:\n", file);
-
-    fp = fopen (file, "r");
-    if (fp)
-    {
-        fseek (fp, 0, SEEK_END);
-        len = ftell (fp);
-        fseek (fp, 0, SEEK_SET);
-
-        buf = malloc (len + 1);
-        memset (buf, 0, len + 1);
-
-        if (buf)
-        {
-            fread (buf, 1, len, fp);
-            buf[len] = '\0';
-
-            DUMP ("%s", buf);
-        }
-        else
-        {
-            LOG_ERROR ("Failed to allocate buffer (len=%zu)", len + 1);
-        }
+    uint64_t hash = shader_cache_hash (source, len);
+    int length = (int) len;
+    unsigned int id;
 
-        fclose (fp);
-    }
-    else
+    if ((id = shader_cache_find (type, hash)) != 0)
     {
-        LOG_ERROR ("Failed to read file: '%s'", file);
+        *cached = true;
+        return id;
     }
 
-    ASSERT (buf != NULL);
+    GLCALL (id = glCreateShader (type));
+    GLCALL (glShaderSource (id, 1/* count */, &source, &length));
+    GLCALL (glCompileShader (id));
+
+    *cached = shader_cache_insert (type, hash, id);
 
-    return buf;
+    return id;
 }
 
-static unsigned int
-shader_compile (unsigned int type, char *source)
+static void
+shader_log_errors (unsigned int id)
 {
-    unsigned int id;
     char *message;
     int result;
+    int type;
     int len;
 
-    GLCALL (id = glCreateShader (type));
-    GLCALL (glShaderSource (id, 1/* count */, &source, NULL/* length */));
-    GLCALL (glCompileShader (id));
-
     glGetShaderiv (id, GL_COMPILE_STATUS, &result);
     if (result == GL_FALSE)
     {
+        glGetShaderiv (id, GL_SHADER_TYPE, &type);
         glGetShaderiv (id, GL_INFO_LOG_LENGTH, &len);
         message = alloca (len * sizeof (char));
         glGetShaderInfoLog (id, len, NULL, message);
@@ -328,106 +596,226 @@ shader_compile (unsigned int type, char *source)
         fprintf (stderr, YELLOW"Failed to compile %s shader:\n%s\n"NORMAL,
                 (type == GL_VERTEX_SHADER ? "vertex" : "fragment"),
                 message);
-
-        glDeleteShader (id);
-        id = 0;
     }
+}
+
+/* Called once the link is known to have succeeded */
+static void
+program_finish (struct program *p)
+{
+    Uint64 now = SDL_GetPerformanceCounter ();
 
-    ASSERT (id != 0);
+    glValidateProgram (p->id);
+    program_reflect (p);
+    camera_bind_program (p->id);
+    p->status = PROGRAM_READY;
 
-    return id;
+    printf ("Program %u (%s, %s) ready after %.2f ms\n", p->id, p->vertex_file, p->fragment_file,
+            (now - p->submitted) * 1000.0 / SDL_GetPerformanceFrequency ());
 }
 
-static unsigned int
-shader_create (char *vertex_file, char *fragment_file)
+/**
+ * Non-blocking once KHR_parallel_shader_compile is available: until the
+ * driver reports completion the program stays pending. Without it the
+ * first poll waits for the link, which most drivers defer until then
+ * anyway, so submitting everything up front still overlaps the work.
+ */
+static void
+program_poll (struct program *p)
 {
-    char *vertex_source = read_file_to_buffer (vertex_file);
-    char *fragment_source = read_file_to_buffer (fragment_file);
-    unsigned int program_id = 0;
-    unsigned int vert_id = 0;
-    unsigned int frag_id = 0;
+    unsigned int shaders[2];
     char *message;
+    int count = 0;
     int result;
     int len;
 
-    if (vertex_source && fragment_source)
+    if (p->status != PROGRAM_PENDING)
     {
-        vert_id = shader_compile (GL_VERTEX_SHADER, vertex_source);
-        frag_id = shader_compile (GL_FRAGMENT_SHADER, fragment_source);
-        program_id = glCreateProgram ();
-
-        glAttachShader (program_id, vert_id);
-        glAttachShader (program_id, frag_id);
-        glLinkProgram (program_id);
-        glValidateProgram (program_id);
+        return;
+    }
 
-        glGetProgramiv (program_id, GL_LINK_STATUS, &result);
+    if (g__parallel_compile)
+    {
+        GLCALL (glGetProgramiv (p->id, GL_COMPLETION_STATUS_KHR, &result));
         if (result == GL_FALSE)
         {
-            glGetProgramiv (program_id, GL_INFO_LOG_LENGTH, &len);
-            message = alloca (len * sizeof (char));
-            glGetProgramInfoLog (program_id, len, NULL, message);
-
-            fprintf (stderr, YELLOW"Failed to link shader program:\n%s\n"NORMAL, message);
+            return;
+        }
+    }
 
-            program_id = 0;
+    glGetProgramiv (p->id, GL_LINK_STATUS, &result);
+    if (result == GL_FALSE)
+    {
+        glGetAttachedShaders (p->id, LEN (shaders), &count, shaders);
+        for (int i = 0; i < count; i++)
+        {
+            shader_log_errors (shaders[i]);
         }
 
-        // TODO: not entirely sure if this is needed, but it doesn't
-        //       seem to cause any problems??
-        // glDetachShader (program_id, vert_id);
-        // glDetachShader (program_id, frag_id);
+        glGetProgramiv (p->id, GL_INFO_LOG_LENGTH, &len);
+        message = alloca (len * sizeof (char));
+        glGetProgramInfoLog (p->id, len, NULL, message);
+
+        fprintf (stderr, YELLOW"Failed to link shader program (%s, %s):\n%s\n"NORMAL,
+                 p->vertex_file, p->fragment_file, message);
 
-        glDeleteShader (vert_id);
-        glDeleteShader (frag_id);
+        p->status = PROGRAM_FAILED;
+        return;
     }
 
-    if (vertex_source) free (vertex_source);
-    if (fragment_source) free (fragment_source);
+    progcache_store (p->cache_key, p->id);
+    program_finish (p);
+}
 
-    ASSERT (program_id != 0);
+/* Render functions skip their draws until this is true */
+static bool
+program_ready (struct program *p)
+{
+    program_poll (p);
 
-    return program_id;
+    return p->status == PROGRAM_READY;
 }
 
-static unsigned int
-texture_create (char *file)
+static void
+program_wait (struct program *p)
 {
-    unsigned char *data;
-    unsigned int id = 0;
-    int bytes_per_pixel;
-    int w;
-    int h;
+    while (p->status == PROGRAM_PENDING)
+    {
+        program_poll (p);
+    }
+}
 
-    stbi_set_flip_vertically_on_load (1);
-    data = stbi_load (file, &w, &h, &bytes_per_pixel, 4);
+/* No GL, safe on any thread. `files` is shared across a batch (see shaderpp.h), may be NULL */
+static bool
+shader_sources_load (struct shader_sources *s, const char *vertex_file, const char *fragment_file, unsigned int defines,
+                     struct shaderpp_files *files)
+{
+    memset (s, 0, sizeof (*s));
+    s->vertex = shaderpp_load (vertex_file, defines, files, &s->vertex_len);
+    s->fragment = shaderpp_load (fragment_file, defines, files, &s->fragment_len);
 
-    if (data)
+    if (s->vertex && s->fragment)
     {
-        GLCALL (glGenTextures (1, &id));
-        GLCALL (glBindTexture (GL_TEXTURE_2D, id));
+        s->cache_key = progcache_key (s->vertex, s->vertex_len, s->fragment, s->fragment_len);
+    }
 
-        GLCALL (glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-        GLCALL (glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-        GLCALL (glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE)); // GL_REPEAT?
-        GLCALL (glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE)); // GL_REPEAT?
+    return s->vertex && s->fragment;
+}
 
-        GLCALL (glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data));
-        GLCALL (glGenerateMipmap (GL_TEXTURE_2D));
-        GLCALL (glBindTexture (GL_TEXTURE_2D, 0));
+static void
+shader_sources_free (struct shader_sources *s)
+{
+    free (s->vertex);
+    free (s->fragment);
+    memset (s, 0, sizeof (*s));
+}
+
+static void
+program_init (struct program *p, const char *vertex_file, const char *fragment_file, unsigned int defines)
+{
+    memset (p, 0, sizeof (*p));
+    snprintf (p->vertex_file, sizeof (p->vertex_file), "%s", vertex_file);
+    snprintf (p->fragment_file, sizeof (p->fragment_file), "%s", fragment_file);
+    p->defines = defines;
+    p->variant_key = program_variant_key (vertex_file, fragment_file, defines);
+    p->submitted = SDL_GetPerformanceCounter ();
+}
+
+/**
+ * The GL side of building a program: a cached binary if `use_cache`,
+ * otherwise the compile and link are submitted. Sources that failed to
+ * load leave the program failed.
+ */
+static void
+program_submit (struct program *p, const struct shader_sources *s, bool use_cache)
+{
+    unsigned int vert_id = 0;
+    unsigned int frag_id = 0;
+    bool vert_cached = true;
+    bool frag_cached = true;
 
-        stbi_image_free (data);
+    if (s->vertex && s->fragment)
+    {
+        p->cache_key = s->cache_key;
+        p->id = use_cache ? progcache_load (p->cache_key) : 0;
 
-        printf ("Load texture '%s' (id=%u w=%d h=%d bpp=%d)\n", file, id, w, h, bytes_per_pixel);
+        if (p->id)
+        {
+            program_finish (p);
+        }
+        else
+        {
+            vert_id = shader_submit (GL_VERTEX_SHADER, s->vertex, s->vertex_len, &vert_cached);
+            frag_id = shader_submit (GL_FRAGMENT_SHADER, s->fragment, s->fragment_len, &frag_cached);
+
+            GLCALL (p->id = glCreateProgram ());
+            GLCALL (glAttachShader (p->id, vert_id));
+            GLCALL (glAttachShader (p->id, frag_id));
+            progcache_prepare (p->id);
+            GLCALL (glLinkProgram (p->id));
+            p->status = PROGRAM_PENDING;
+
+            /* attached shaders are only flagged, they live until the program goes */
+            if (!vert_cached) glDeleteShader (vert_id);
+            if (!frag_cached) glDeleteShader (frag_id);
+        }
     }
-    else
+
+    /* a hot reload can catch a file mid-save, that mustn't take us down */
+    if (p->id == 0)
     {
-        LOG_ERROR ("Failed to load file '%s'", file);
+        LOG_ERROR ("Failed to create program (%s, %s)", p->vertex_file, p->fragment_file);
+        p->status = PROGRAM_FAILED;
     }
+}
 
-    ASSERT (id > 0);
+/**
+ * Submits the compile and link and returns straight away. The program
+ * id is valid immediately, but it can only be drawn with once
+ * program_ready() says so.
+ */
+static void
+shader_create (struct program *p, const char *vertex_file, const char *fragment_file, unsigned int defines)
+{
+    struct shader_sources sources;
 
-    return id;
+    program_init (p, vertex_file, fragment_file, defines);
+    shader_sources_load (&sources, vertex_file, fragment_file, defines, NULL);
+    program_submit (p, &sources, true);
+    shader_sources_free (&sources);
+}
+
+/**
+ * Finds the (vertex, fragment, defines) permutation among a render
+ * target's program slots, submitting it into a free slot the first time
+ * it is asked for. Setup asks for the variants it knows it will draw so
+ * they compile up front; anything else is built on first use. A variant
+ * that failed keeps its slot and stays failed until a hot reload
+ * rebuilds it, render functions skip it like a pending one.
+ */
+static struct program *
+program_variant (struct program *slots, int slot_count, const char *vertex_file, const char *fragment_file,
+                 unsigned int defines)
+{
+    uint64_t key = program_variant_key (vertex_file, fragment_file, defines);
+    int free_slot = -1;
+
+    for (int i = 0; i < slot_count; i++)
+    {
+        if (slots[i].variant_key == 0)
+        {
+            if (free_slot < 0) free_slot = i;
+        }
+        else if (slots[i].variant_key == key)
+        {
+            return &slots[i];
+        }
+    }
+
+    ASSERT (free_slot >= 0);
+    shader_create (&slots[free_slot], vertex_file, fragment_file, defines);
+
+    return &slots[free_slot];
 }
 
 static void
@@ -461,29 +849,31 @@ square_setup (struct render_target *r)
     GLCALL (glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof (float), (void *) 0));
     GLCALL (glEnableVertexAttribArray (0));
 
-    unsigned int shader_id = shader_create ("square.vs", "square.fs");
-
-    ASSERT (shader_id != 0);
-    ASSERT (vao != 0);
-
-    r->shader_id = shader_id;
+    shader_create (&r->program, SETUP_ASSET (SQUARE_VS), SETUP_ASSET (SQUARE_FS), 0);
     r->vao = vao;
+    r->view = m4_identity ();
+    r->projection = m4_identity ();
+
+    ASSERT (r->program.id != 0);
+    ASSERT (r->vao != 0);
 }
 
 static void
-square_render (struct render_target *r)
+square_render (struct frame *frame, struct render_target *r)
 {
-    float ticks =  SDL_GetTicks () / 1000.0f;
-    float green = (sin (ticks) / 2.0f) + 0.5f;
-    int vert_colour_location;
+    float green = (sin (frame->clock.secs) / 2.0f) + 0.5f;
 
-    GLCALL (glUseProgram (r->shader_id));
-    GLCALL (vert_colour_location = glGetUniformLocation (r->shader_id, "u_colour"));
-    GLCALL (glUniform4f (vert_colour_location, 0.0f, green, 0.0f, 1.0f));
+    if (!program_ready (&r->program))
+    {
+        return;
+    }
 
-    GLCALL (glBindVertexArray (r->vao));
-    GLCALL (glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0));
-    GLCALL (glBindVertexArray (0));
+    gls_depth_test (false);
+    gls_use_program (r->program.id);
+    GLCALL (glUniform4f (r->program.locations[UNIFORM_COLOUR], 0.0f, green, 0.0f, 1.0f));
+
+    gls_bind_vertex_array (r->vao);
+    GLDRAW (glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0));
 }
 
 static void
@@ -513,20 +903,27 @@ triangle_setup (struct render_target *r)
     GLCALL (glVertexAttribPointer (1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof (float), (void *) (3 * sizeof (float))));
     GLCALL (glEnableVertexAttribArray (1));
 
-    r->shader_id = shader_create ("tri.vs", "tri.fs");
+    shader_create (&r->program, SETUP_ASSET (TRI_VS), SETUP_ASSET (TRI_FS), 0);
     r->vao = vao;
+    r->view = m4_identity ();
+    r->projection = m4_identity ();
 
-    ASSERT (r->shader_id != 0);
+    ASSERT (r->program.id != 0);
     ASSERT (r->vao != 0);
 }
 
 static void
-triangle_render (struct render_target *r)
+triangle_render (struct frame *frame, struct render_target *r)
 {
-    GLCALL (glUseProgram (r->shader_id));
-    GLCALL (glBindVertexArray (r->vao));
-    GLCALL (glDrawArrays (GL_TRIANGLES, 0, 3));
-    GLCALL (glBindVertexArray (0));
+    if (!program_ready (&r->program))
+    {
+        return;
+    }
+
+    gls_depth_test (false);
+    gls_use_program (r->program.id);
+    gls_bind_vertex_array (r->vao);
+    GLDRAW (glDrawArrays (GL_TRIANGLES, 0, 3));
 }
 
 static void
@@ -570,64 +967,58 @@ texture_setup (struct render_target *r)
     GLCALL (glVertexAttribPointer (2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof (float), (void *) (6 * sizeof (float))));
     GLCALL (glEnableVertexAttribArray (2));
 
-    r->texture_ids[0] = texture_create ("bricks.jpg");
-    r->texture_ids[1] = texture_create ("face.png");
-    r->shader_ids[0] = shader_create ("tex.vs", "tex.fs");
-    r->shader_ids[1] = shader_create ("tex.vs", "tex-colour.fs");
-    r->shader_ids[2] = shader_create ("tex.vs", "tex-face.fs");
+    r->texture_ids[0] = texture_request (SETUP_ASSET (BRICKS), TEXTURE_LOW_PRECISION);
+    r->texture_ids[1] = texture_request (SETUP_ASSET (FACE), 0);
+    program_variant (r->programs, LEN (r->programs), SETUP_ASSET (TEX_VS), SETUP_ASSET (TEX_FS),
+                     g__texture_variants[0]);
     r->vao = vao;
+    r->view = m4_identity ();
+    r->projection = m4_identity ();
 
     ASSERT (r->texture_ids[0] != 0);
     ASSERT (r->texture_ids[1] != 0);
-    ASSERT (r->shader_ids[0] != 0);
-    ASSERT (r->shader_ids[1] != 0);
-    ASSERT (r->shader_ids[2] != 0);
+    ASSERT (r->programs[0].id != 0);
     ASSERT (r->vao != 0);
 }
 
 static void
-texture_render (struct context *ctx, struct render_target *rt)
+texture_render (struct frame *frame, struct render_target *rt)
 {
-    unsigned int shader_id = rt->shader_ids[ctx->variation];
-    unsigned int tex_location;
-    unsigned int xfrm_location;
+    struct program *program = program_variant (rt->programs, LEN (rt->programs),
+                                               SETUP_ASSET (TEX_VS), SETUP_ASSET (TEX_FS),
+                                               g__texture_variants[frame->variation]);
     mat4_t xfrm;
 
+    if (!program_ready (program))
+    {
+        return;
+    }
+
     xfrm = m4_identity (); // same as glm:mat4(1.0f);
-    if (ctx->rotate)
+    if (frame->rotate)
     {
-        float secs = SDL_GetTicks () / 1000.0;
+        float secs = frame->clock.secs;
         xfrm = m4_translation (vec3 (0.5, -0.5, 0.0));
         xfrm = m4_mul (xfrm, m4_rotation (secs, vec3 (0.0, 0.0, 1.0)));
     }
 
-    GLCALL (glUseProgram (shader_id));
-    GLCALL (xfrm_location = glGetUniformLocation (shader_id, "u_xfrm"));
-    GLCALL (glUniformMatrix4fv (xfrm_location, 1, GL_FALSE, &xfrm.m[0][0]));
-    GLCALL (tex_location = glGetUniformLocation (shader_id, "u_texture0"));
-    GLCALL (glUniform1i (tex_location, 0));
+    gls_depth_test (false);
+    gls_use_program (program->id);
+    GLCALL (glUniformMatrix4fv (program->locations[UNIFORM_XFRM], 1, GL_FALSE, &xfrm.m[0][0]));
+    GLCALL (glUniform1i (program->locations[UNIFORM_TEXTURE0], 0));
 
-    GLCALL (glActiveTexture (GL_TEXTURE0));
-    GLCALL (glBindTexture (GL_TEXTURE_2D, rt->texture_ids[0]));
-    if (ctx->variation == 2)
+    gls_bind_texture (0, rt->texture_ids[0]);
+    if (g__texture_variants[frame->variation] & SHADER_TEX_MIX)
     {
-        GLCALL (glUseProgram (shader_id));
-        GLCALL (tex_location = glGetUniformLocation (shader_id, "u_texture1"));
-        GLCALL (glUniform1i (tex_location, 1));
+        GLCALL (glUniform1i (program->locations[UNIFORM_TEXTURE1], 1));
 
-        GLCALL (glActiveTexture (GL_TEXTURE1));
-        GLCALL (glBindTexture (GL_TEXTURE_2D, rt->texture_ids[1]));
+        gls_bind_texture (1, rt->texture_ids[1]);
     }
 
-    GLCALL (glBindVertexArray (rt->vao));
+    gls_bind_vertex_array (rt->vao);
 
     /* draw */
-    GLCALL (glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0));
-
-    /* cleanup */
-    GLCALL (glBindVertexArray (0));
-    GLCALL (glBindTexture (GL_TEXTURE_2D, 0)); 
-    GLCALL (glUseProgram (0));
+    GLDRAW (glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0));
 }
 
 static void
@@ -694,19 +1085,52 @@ cube_setup (struct render_target *rt)
     glVertexAttribPointer (1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof (float), (void *) (3 * sizeof (float)));
     glEnableVertexAttribArray (1);
 
-    rt->texture_ids[0] = texture_create ("container.jpg");
-    rt->texture_ids[1] = texture_create ("face.png");
-    rt->shader_ids[0] = shader_create ("cube.vs", "cube.fs");
+    /* same vertices plus one model matrix per instance */
+    unsigned int instance_vao;
+    GLCALL (glGenVertexArrays (1, &instance_vao));
+    GLCALL (glBindVertexArray (instance_vao));
+    GLCALL (glBindBuffer (GL_ARRAY_BUFFER, vbo));
+    GLCALL (glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof (float), (void *) 0));
+    GLCALL (glEnableVertexAttribArray (0));
+    GLCALL (glVertexAttribPointer (1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof (float), (void *) (3 * sizeof (float))));
+    GLCALL (glEnableVertexAttribArray (1));
+
+    unsigned int instance_vbo;
+    GLCALL (glGenBuffers (1, &instance_vbo));
+    GLCALL (glBindBuffer (GL_ARRAY_BUFFER, instance_vbo));
+    GLCALL (glBufferData (GL_ARRAY_BUFFER, CUBE_MAX_INSTANCES * sizeof (mat4_t), NULL, GL_STREAM_DRAW));
+
+    // model matrix attribute (locations 2-5, one column each)
+    for (int i = 0; i < 4; i++)
+    {
+        GLCALL (glVertexAttribPointer (2 + i, 4, GL_FLOAT, GL_FALSE, sizeof (mat4_t), (void *) (i * 4 * sizeof (float))));
+        GLCALL (glEnableVertexAttribArray (2 + i));
+        GLCALL (glVertexAttribDivisor (2 + i, 1));
+    }
+
+    rt->texture_ids[0] = texture_request (SETUP_ASSET (BRICKS), TEXTURE_LOW_PRECISION);
+    rt->texture_ids[1] = texture_request (SETUP_ASSET (FACE), 0);
+    program_variant (rt->programs, LEN (rt->programs), SETUP_ASSET (CUBE_VS), SETUP_ASSET (TEX_FS), SHADER_TEX_MIX);
+    program_variant (rt->programs, LEN (rt->programs), SETUP_ASSET (CUBE_VS), SETUP_ASSET (TEX_FS),
+                     SHADER_TEX_MIX | SHADER_INSTANCED);
     rt->vao = vao;
+    rt->vbo = vbo;
+    rt->instance_vao = instance_vao;
+    rt->instance_vbo = instance_vbo;
+    rt->instance_capacity = CUBE_MAX_INSTANCES;
+    rt->view = m4_translation (vec3 (0.0, 0.0, -3.0));
+    rt->projection = m4_perspective (45.0, (float) WINDOW_WIDTH_PX / WINDOW_HEIGHT_PX, 0.1, 100.0);
 
     ASSERT (rt->texture_ids[0] != 0);
     ASSERT (rt->texture_ids[1] != 0);
-    ASSERT (rt->shader_ids[0] != 0);
+    ASSERT (rt->programs[0].id != 0);
+    ASSERT (rt->programs[1].id != 0);
     ASSERT (rt->vao != 0);
+    ASSERT (rt->instance_vao != 0);
 }
 
 static void
-cube_render (struct context *ctx, struct render_target *rt)
+cube_render (struct frame *frame, struct render_target *rt)
 {
     vec3_t cubes[] = {
         {  2.0,  5.0, -15.0 },
@@ -720,127 +1144,1083 @@ cube_render (struct context *ctx, struct render_target *rt)
         { -1.3,  1.0, -1.5  }
     };
 
-    unsigned int shader_id = rt->shader_ids[0];
-    mat4_t model;
-    mat4_t view;
-    mat4_t projection;
-    unsigned int model_location;
-    unsigned int view_location;
-    unsigned int projection_location;
-    unsigned int tex0_location;
-    unsigned int tex1_location;
-    float secs = SDL_GetTicks () / 1000.0;
+    struct program *program = program_variant (rt->programs, LEN (rt->programs),
+                                               SETUP_ASSET (CUBE_VS), SETUP_ASSET (TEX_FS),
+                                               SHADER_TEX_MIX | (frame->instanced ? SHADER_INSTANCED : 0));
+    mat4_t models[1 + LEN (cubes)];
+    int count = 1 + frame->variation;
+    float secs = frame->clock.secs;
 
-    model = m4_identity ();
-    model = m4_mul (model, m4_rotation (secs, vec3 (0.5, 1.0, 0.0)));
+    ASSERT (count <= rt->instance_capacity);
 
-    view = m4_translation (vec3 (0.0, 0.0, -3.0));
+    if (!program_ready (program))
+    {
+        return;
+    }
 
-    projection = m4_perspective (45.0, 800.0 / 600.0, 0.1, 100.0);
+    models[0] = m4_identity ();
+    models[0] = m4_mul (models[0], m4_rotation (secs, vec3 (0.5, 1.0, 0.0)));
 
-    GLCALL (glEnable (GL_DEPTH_TEST));
-    GLCALL (glDepthFunc (GL_LESS));
-    GLCALL (glUseProgram (shader_id));
+    for (int i = 1; i < count; i++)
+    {
+        models[i] = m4_translation (cubes[i - 1]);
+        models[i] = m4_mul (models[i], m4_rotation (secs, vec3 (1.0, 0.3, 0.5)));
+    }
 
-    /* camera */
-    GLCALL (model_location = glGetUniformLocation (shader_id, "u_model"));
-    GLCALL (view_location = glGetUniformLocation (shader_id, "u_view"));
-    GLCALL (projection_location = glGetUniformLocation (shader_id, "u_projection"));
-    GLCALL (glUniformMatrix4fv (model_location, 1, GL_FALSE, &model.m[0][0]));
-    GLCALL (glUniformMatrix4fv (view_location, 1, GL_FALSE, &view.m[0][0]));
-    GLCALL (glUniformMatrix4fv (projection_location, 1, GL_FALSE, &projection.m[0][0]));
+    gls_depth_test (true);
+    gls_depth_func (GL_LESS);
+    gls_use_program (program->id);
 
     /* brick texture */
-    GLCALL (tex0_location = glGetUniformLocation (shader_id, "u_texture0"));
-    GLCALL (glUniform1i (tex0_location, 0));
-    GLCALL (glActiveTexture (GL_TEXTURE0));
-    GLCALL (glBindTexture (GL_TEXTURE_2D, rt->texture_ids[0]));
+    GLCALL (glUniform1i (program->locations[UNIFORM_TEXTURE0], 0));
+    gls_bind_texture (0, rt->texture_ids[0]);
 
     /* face texture */
-    GLCALL (tex1_location = glGetUniformLocation (shader_id, "u_texture1"));
-    GLCALL (glUniform1i (tex1_location, 1));
-    GLCALL (glActiveTexture (GL_TEXTURE1));
-    GLCALL (glBindTexture (GL_TEXTURE_2D, rt->texture_ids[1]));
+    GLCALL (glUniform1i (program->locations[UNIFORM_TEXTURE1], 1));
+    gls_bind_texture (1, rt->texture_ids[1]);
 
     /* draw */
-    GLCALL (glBindVertexArray (rt->vao));
-    GLCALL (glDrawArrays (GL_TRIANGLES, 0, 36));
-
-    for (int i = 0; i < ctx->variation; i++)
+    if (frame->instanced)
     {
-        model = m4_translation (cubes[i]);
-        model = m4_mul (model, m4_rotation (secs, vec3 (1.0, 0.3, 0.5)));
-        GLCALL (glUniformMatrix4fv (model_location, 1, GL_FALSE, &model.m[0][0]));
-        GLCALL (glDrawArrays (GL_TRIANGLES, 0, 36));
+        GLCALL (glBindBuffer (GL_ARRAY_BUFFER, rt->instance_vbo));
+        GLCALL (glBufferData (GL_ARRAY_BUFFER, rt->instance_capacity * sizeof (mat4_t), NULL, GL_STREAM_DRAW));
+        GLCALL (glBufferSubData (GL_ARRAY_BUFFER, 0, count * sizeof (mat4_t), models));
+
+        gls_bind_vertex_array (rt->instance_vao);
+        GLDRAW (glDrawArraysInstanced (GL_TRIANGLES, 0, 36, count));
     }
+    else
+    {
+        gls_bind_vertex_array (rt->vao);
 
-    /* cleanup */
-    GLCALL (glDisable (GL_DEPTH_TEST));
+        for (int i = 0; i < count; i++)
+        {
+            GLCALL (glUniformMatrix4fv (program->locations[UNIFORM_MODEL], 1, GL_FALSE, &models[i].m[0][0]));
+            GLDRAW (glDrawArrays (GL_TRIANGLES, 0, 36));
+        }
+    }
 }
 
-int
-main (int c, char **v)
+/* Instanced cubes from the scene generator, sharing the cube's vertices, textures and program */
+static void
+stress_setup (struct render_target *rt, struct render_target *cube, struct scene *scene, int capacity)
 {
-    struct context ctx = {0};
-
-    init (&ctx);
-
-    GLCALL (glViewport (0, 0, WINDOW_WIDTH_PX, WINDOW_HEIGHT_PX));
+    unsigned int vao;
+    GLCALL (glGenVertexArrays (1, &vao));
+    GLCALL (glBindVertexArray (vao));
+    GLCALL (glBindBuffer (GL_ARRAY_BUFFER, cube->vbo));
+    GLCALL (glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof (float), (void *) 0));
+    GLCALL (glEnableVertexAttribArray (0));
+    GLCALL (glVertexAttribPointer (1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof (float), (void *) (3 * sizeof (float))));
+    GLCALL (glEnableVertexAttribArray (1));
 
-    /**
-     * +-------------------- +
-     * |  VAO 1              |          +-------------------------+
-     * |                     |          |  VBO 1                  |
-     * | attribute pointer 0 -----------> pos[0] pos[1] .. pos[n] |
-     * | attribute pointer 1 |          +---|------|--------------+
-     * |                     |              +------+
-     * |                     |               stride
-     * | element buffer obj ------+
-     * +---------------------+    |     +---------+
-     *                            |     |  EBO 1  |
-     *                            +-----> indices |
-     *                                  +---------+
-     */
-    square_setup (&ctx.render_targets[STATE_RENDER_SQUARE]);
-    triangle_setup (&ctx.render_targets[STATE_RENDER_TRIANGLE]);
-    texture_setup (&ctx.render_targets[STATE_RENDER_TEXTURE]);
-    cube_setup (&ctx.render_targets[STATE_RENDER_CUBE]);
+    unsigned int instance_vbo;
+    GLCALL (glGenBuffers (1, &instance_vbo));
+    GLCALL (glBindBuffer (GL_ARRAY_BUFFER, instance_vbo));
+    GLCALL (glBufferData (GL_ARRAY_BUFFER, capacity * sizeof (mat4_t), NULL, GL_STREAM_DRAW));
 
-    g__running = true;
-    while (g__running)
+    for (int i = 0; i < 4; i++)
     {
-        struct render_target *rt;
+        GLCALL (glEnableVertexAttribArray (2 + i));
+        GLCALL (glVertexAttribDivisor (2 + i, 1));
+    }
 
-        handle_input (&ctx);
+    rt->vao = vao;
+    rt->instance_vbo = instance_vbo;
+    rt->instance_capacity = capacity;
+    rt->shared = cube;
+    rt->scene = scene;
 
-        GLCALL (glClearColor (0.2, 0.3, 0.3, 1.0));
-        GLCALL (glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-        GLCALL (glPolygonMode (GL_FRONT_AND_BACK, ctx.draw_wireframes ? GL_LINE : GL_FILL));
+    ASSERT (rt->vao != 0);
+    ASSERT (rt->instance_vbo != 0);
+}
 
-        rt = &ctx.render_targets[ctx.state];
+/* Looks at the whole scene from outside, so culling only trims the edges */
+static void
+stress_camera (struct render_target *rt)
+{
+    float extent = rt->scene->extent;
+
+    rt->view = m4_translation (vec3 (0.0, 0.0, -2.2 * extent));
+    rt->projection = m4_perspective (45.0, (float) WINDOW_WIDTH_PX / WINDOW_HEIGHT_PX, 0.1, 4.0 * extent);
+}
+
+static void
+stress_render (struct frame *frame, struct render_target *rt)
+{
+    struct scene *sc = rt->scene;
+    struct program *program = program_variant (rt->shared->programs, LEN (rt->shared->programs),
+                                               SETUP_ASSET (CUBE_VS), SETUP_ASSET (TEX_FS),
+                                               SHADER_TEX_MIX | SHADER_INSTANCED);
+    unsigned int *texture_ids = rt->shared->texture_ids;
+    Uint64 freq = SDL_GetPerformanceFrequency ();
+    Uint64 t0, t1, t2, t3;
+
+    ASSERT (sc->count <= rt->instance_capacity);
+
+    if (!program_ready (program))
+    {
+        return;
+    }
+
+    t0 = SDL_GetPerformanceCounter ();
+    scene_update (sc, frame->clock.secs);
+
+    t1 = SDL_GetPerformanceCounter ();
+    scene_cull (sc, &g__camera.block.view_projection);
 
-        switch (ctx.state)
+    t2 = SDL_GetPerformanceCounter ();
+    gls_depth_test (true);
+    gls_depth_func (GL_LESS);
+    gls_use_program (program->id);
+    GLCALL (glUniform1i (program->locations[UNIFORM_TEXTURE0], 0));
+    GLCALL (glUniform1i (program->locations[UNIFORM_TEXTURE1], 1));
+    gls_bind_vertex_array (rt->vao);
+
+    GLCALL (glBindBuffer (GL_ARRAY_BUFFER, rt->instance_vbo));
+    GLCALL (glBufferData (GL_ARRAY_BUFFER, rt->instance_capacity * sizeof (mat4_t), NULL, GL_STREAM_DRAW));
+
+    for (int t = 0; t < SCENE_TEXTURES; t++)
+    {
+        int first = sc->texture_first[t];
+        int count = sc->visible_count[t];
+        size_t offset = first * sizeof (mat4_t);
+
+        if (count == 0)
         {
-            case STATE_RENDER_SQUARE:
-                square_render (rt);
-                break;
-            case STATE_RENDER_TRIANGLE:
-                triangle_render (rt);
-                break;
-            case STATE_RENDER_TEXTURE:
-                texture_render (&ctx, rt);
-                break;
-            case STATE_RENDER_CUBE:
-                cube_render (&ctx, rt);
-                break;
+            continue;
+        }
+
+        GLCALL (glBufferSubData (GL_ARRAY_BUFFER, offset, count * sizeof (mat4_t), &sc->visible[first]));
+
+        /* no base instance in 3.3, so point the instance attributes at this range */
+        for (int i = 0; i < 4; i++)
+        {
+            GLCALL (glVertexAttribPointer (2 + i, 4, GL_FLOAT, GL_FALSE, sizeof (mat4_t), (void *) (offset + i * 4 * sizeof (float))));
+        }
+
+        gls_bind_texture (0, texture_ids[t]);
+        gls_bind_texture (1, texture_ids[1 - t]);
+        GLDRAW (glDrawArraysInstanced (GL_TRIANGLES, 0, 36, count));
+    }
+
+    t3 = SDL_GetPerformanceCounter ();
+
+    sc->stats.frames++;
+    sc->stats.update_ms += (t1 - t0) * 1000.0 / freq;
+    sc->stats.cull_ms += (t2 - t1) * 1000.0 / freq;
+    sc->stats.submit_ms += (t3 - t2) * 1000.0 / freq;
+    sc->stats.visible += sc->visible_count[0] + sc->visible_count[1];
+
+    if (sc->stats.frames >= PACER_REPORT_FRAMES && !frame->bench)
+    {
+        scene_report (sc);
+        memset (&sc->stats, 0, sizeof (sc->stats));
+    }
+}
+
+/* Every program the render targets own, shared targets own none. Failed ones count, hot reload rebuilds them */
+static int
+programs_collect (struct context *ctx, struct program **list, int max)
+{
+    int count = 0;
+
+    for (int i = 0; i < STATE_RENDER_MAX; i++)
+    {
+        struct render_target *rt = &ctx->render_targets[i];
+
+        if (rt->program.variant_key)
+        {
+            ASSERT (count < max);
+            list[count++] = &rt->program;
+        }
+
+        for (int j = 0; j < LEN (rt->programs); j++)
+        {
+            if (rt->programs[j].variant_key)
+            {
+                ASSERT (count < max);
+                list[count++] = &rt->programs[j];
+            }
+        }
+    }
+
+    return count;
+}
+
+/* Blocks until every submitted program has finished linking (or failed) */
+static void
+programs_wait_all (struct context *ctx)
+{
+    struct program *programs[PROGRAMS_MAX];
+    int count = programs_collect (ctx, programs, LEN (programs));
+
+    for (int i = 0; i < count; i++)
+    {
+        program_wait (programs[i]);
+    }
+}
+
+static void
+hot_reload_start (struct context *ctx)
+{
+    struct program *programs[PROGRAMS_MAX];
+    int count = programs_collect (ctx, programs, LEN (programs));
+
+    for (int i = 0; i < count; i++)
+    {
+        watch_add_file (&ctx->watch, programs[i]->vertex_file);
+        watch_add_file (&ctx->watch, programs[i]->fragment_file);
+    }
+
+    for (int i = 0; i < g__shader_include_count; i++)
+    {
+        watch_add_file (&ctx->watch, g__shader_includes[i]);
+    }
+
+    watch_start (&ctx->watch, asset_override_dir ());
+    printf ("Watching shaders for changes\n");
+}
+
+static void
+_hot_reload_discard (struct program *p)
+{
+    if (p->reload->id) glDeleteProgram (p->reload->id);
+    free (p->reload);
+    p->reload = NULL;
+}
+
+/* Worker side: reads and preprocesses the whole batch, every file once */
+static void
+_hot_reload_job (struct job *job)
+{
+    struct hot_reload *hr = job->data;
+    struct shaderpp_files files = {0};
+
+    for (int i = 0; i < hr->build_count; i++)
+    {
+        struct hot_reload_build *b = &hr->builds[i];
+
+        shader_sources_load (&b->sources, b->next->vertex_file, b->next->fragment_file, b->next->defines, &files);
+    }
+
+    shaderpp_files_close (&files);
+}
+
+/**
+ * Runs on the render thread before each frame. Changed files mark every
+ * program using them stale; stale programs are handed to a worker in one
+ * batch which reads and preprocesses their sources, so the render thread
+ * never touches the file system. Once the batch is back each rebuild is
+ * submitted into a separate slot; the frame keeps drawing with the old
+ * program until the new one has linked, then the whole struct (id,
+ * uniforms, locations) is swapped in between two frames. A rebuild that
+ * fails is thrown away and the old program stays.
+ */
+static void
+hot_reload_update (struct context *ctx)
+{
+    struct hot_reload *hr = &ctx->hot_reload;
+    struct program *programs[PROGRAMS_MAX];
+    struct watch_event e;
+    Uint64 freq = SDL_GetPerformanceFrequency ();
+    int count;
+
+    if (!ctx->watch.thread)
+    {
+        return;
+    }
+
+    count = programs_collect (ctx, programs, LEN (programs));
+
+    while (watch_poll (&ctx->watch, &e))
+    {
+        for (int i = 0; i < count; i++)
+        {
+            struct program *p = programs[i];
+
+            /* includes aren't tracked per program, rebuild everything */
+            if (strcmp (p->vertex_file, e.name) != 0 && strcmp (p->fragment_file, e.name) != 0 &&
+                !shaderpp_is_include (e.name))
+            {
+                continue;
+            }
+
+            /* latency counts from the first change the rebuild picks up */
+            if (!p->stale) p->stale = e.time;
+        }
+    }
+
+    if (hr->busy && job_done (&hr->job))
+    {
+        for (int i = 0; i < hr->build_count; i++)
+        {
+            struct hot_reload_build *b = &hr->builds[i];
+            Uint64 start = SDL_GetPerformanceCounter ();
+
+            /* saved again before the last rebuild finished, this one supersedes it */
+            if (b->target->reload) _hot_reload_discard (b->target);
+
+            program_submit (b->next, &b->sources, false);
+            shader_sources_free (&b->sources);
+            b->next->reload_ms = (SDL_GetPerformanceCounter () - start) * 1000.0 / freq;
+            b->target->reload = b->next;
+        }
+
+        hr->busy = false;
+    }
+
+    if (!hr->busy)
+    {
+        hr->build_count = 0;
+
+        for (int i = 0; i < count && hr->build_count < LEN (hr->builds); i++)
+        {
+            struct program *p = programs[i];
+            struct hot_reload_build *b;
+
+            if (!p->stale)
+            {
+                continue;
+            }
+
+            b = &hr->builds[hr->build_count++];
+            b->target = p;
+            b->next = malloc (sizeof (*b->next));
+            ASSERT (b->next != NULL);
+
+            program_init (b->next, p->vertex_file, p->fragment_file, p->defines);
+            b->next->changed = p->stale;
+            p->stale = 0;
+        }
+
+        if (hr->build_count > 0)
+        {
+            hr->job.run = _hot_reload_job;
+            hr->job.data = hr;
+            hr->busy = true;
+            workers_submit (&hr->job);
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        struct program *p = programs[i];
+        struct program *next = p->reload;
+        unsigned int old_id = p->id;
+        Uint64 stale = p->stale;
+        Uint64 start;
+        Uint64 end;
+
+        if (!next)
+        {
+            continue;
+        }
+
+        start = SDL_GetPerformanceCounter ();
+        program_poll (next);
+        end = SDL_GetPerformanceCounter ();
+        next->reload_ms += (end - start) * 1000.0 / freq;
+
+        if (next->status == PROGRAM_PENDING)
+        {
+            continue;
+        }
+
+        if (next->status == PROGRAM_FAILED)
+        {
+            LOG_ERROR ("Hot reload of (%s, %s) failed, keeping program %u",
+                       p->vertex_file, p->fragment_file, old_id);
+            hr->failed++;
+            hr->render_ms += next->reload_ms;
+            _hot_reload_discard (p);
+            continue;
+        }
+
+        printf ("Hot reload (%s, %s): program %u -> %u, latency %.2f ms, render thread %.3f ms\n",
+                p->vertex_file, p->fragment_file, old_id, next->id,
+                (end - next->changed) * 1000.0 / freq, next->reload_ms);
+
+        hr->reloads++;
+        hr->latency_ms += (end - next->changed) * 1000.0 / freq;
+        hr->render_ms += next->reload_ms;
+
+        *p = *next;
+        p->reload = NULL;
+        p->stale = stale;   // changed again while this one was building
+        free (next);
+
+        /* the old id may be current and its name can be handed out again */
+        GLCALL (glDeleteProgram (old_id));
+        gls_invalidate ();
+    }
+}
+
+static void
+hot_reload_stop (struct context *ctx)
+{
+    struct hot_reload *hr = &ctx->hot_reload;
+    struct program *programs[PROGRAMS_MAX];
+    int count = programs_collect (ctx, programs, LEN (programs));
+
+    if (!ctx->watch.thread)
+    {
+        return;
+    }
+
+    watch_stop (&ctx->watch);
+
+    if (hr->busy)
+    {
+        job_wait (&hr->job);
+        for (int i = 0; i < hr->build_count; i++)
+        {
+            shader_sources_free (&hr->builds[i].sources);
+            free (hr->builds[i].next);
+        }
+        hr->busy = false;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (programs[i]->reload) _hot_reload_discard (programs[i]);
+    }
+
+    if (hr->reloads + hr->failed > 0)
+    {
+        printf ("Hot reload: %d reloaded, %d failed, mean latency %.2f ms, render thread %.3f ms total\n",
+                hr->reloads, hr->failed, hr->reloads ? hr->latency_ms / hr->reloads : 0.0, hr->render_ms);
+    }
+}
+
+static void
+render_frame (struct context *ctx, struct frame *frame)
+{
+    struct render_target *rt = &ctx->render_targets[frame->state];
+
+    if (frame->pace_mode != ctx->pacer.mode)
+    {
+        pacer_report (&ctx->pacer);
+        pacer_set_mode (&ctx->pacer, frame->pace_mode);
+    }
+
+    hot_reload_update (ctx);
+    texture_stream_update (TEXTURE_UPLOADS_PER_FRAME);
+    camera_update (&rt->view, &rt->projection, &frame->clock);
+
+    gls_clear_colour (0.2, 0.3, 0.3, 1.0);
+    GLCALL (glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    gls_polygon_mode (frame->draw_wireframes ? GL_LINE : GL_FILL);
+
+    switch (frame->state)
+    {
+        case STATE_RENDER_SQUARE:
+            square_render (frame, rt);
+            break;
+        case STATE_RENDER_TRIANGLE:
+            triangle_render (frame, rt);
+            break;
+        case STATE_RENDER_TEXTURE:
+            texture_render (frame, rt);
+            break;
+        case STATE_RENDER_CUBE:
+            cube_render (frame, rt);
+            break;
+        case STATE_RENDER_STRESS:
+            stress_render (frame, rt);
+            break;
+    }
+
+    GLCHECK ("render_frame");
+}
+
+/**
+ * The render thread owns the GL context. It pops frame snapshots pushed
+ * by the main thread, so input and simulation for frame N+1 run while
+ * frame N is being submitted. The queue is only FRAME_QUEUE_LEN deep to
+ * keep latency bounded; the main thread blocks when it is full.
+ */
+static int
+render_thread_main (void *data)
+{
+    struct context *ctx = data;
+    struct render_thread *rth = &ctx->render_thread;
+    struct frame frame;
+
+    ASSERT (SDL_GL_MakeCurrent (ctx->window, ctx->gl) == 0);
+
+    while (SDL_AtomicGet (&rth->running))
+    {
+        SDL_SemWait (rth->frames_queued);
+
+        if (!spsc_pop (&rth->frames, &frame))
+        {
+            continue;
+        }
+
+        pacer_begin_frame (&ctx->pacer);
+        render_frame (ctx, &frame);
+        SDL_GL_SwapWindow (ctx->window);
+        pacer_end_frame (&ctx->pacer);
+
+        SDL_SemPost (rth->frames_free);
+    }
+
+    SDL_GL_MakeCurrent (ctx->window, NULL);
+
+    return 0;
+}
+
+static void
+render_thread_start (struct context *ctx)
+{
+    struct render_thread *rth = &ctx->render_thread;
+
+    spsc_init (&rth->frames, sizeof (struct frame), FRAME_QUEUE_LEN);
+    rth->frames_queued = SDL_CreateSemaphore (0);
+    rth->frames_free = SDL_CreateSemaphore (FRAME_QUEUE_LEN);
+    SDL_AtomicSet (&rth->running, 1);
+
+    /* hand the context over */
+    SDL_GL_MakeCurrent (ctx->window, NULL);
+
+    rth->thread = SDL_CreateThread (render_thread_main, "render", ctx);
+    ASSERT (rth->thread != NULL);
+}
+
+static void
+render_thread_submit (struct render_thread *rth, struct frame *frame)
+{
+    SDL_SemWait (rth->frames_free);
+    ASSERT (spsc_push (&rth->frames, frame));
+    SDL_SemPost (rth->frames_queued);
+}
+
+static void
+render_thread_stop (struct context *ctx)
+{
+    struct render_thread *rth = &ctx->render_thread;
+
+    SDL_AtomicSet (&rth->running, 0);
+    SDL_SemPost (rth->frames_queued);
+    SDL_WaitThread (rth->thread, NULL);
+
+    SDL_DestroySemaphore (rth->frames_queued);
+    SDL_DestroySemaphore (rth->frames_free);
+    spsc_free (&rth->frames);
+
+    /* take the context back for cleanup */
+    SDL_GL_MakeCurrent (ctx->window, ctx->gl);
+}
+
+#define BENCH_MIPS_RUNS 10
+
+struct bench_mips_job
+{
+    struct job job;
+    const unsigned char *rgba;
+    int w;
+    int h;
+};
+
+static void
+_bench_mips_job (struct job *job)
+{
+    struct bench_mips_job *b = job->data;
+    uint64_t size;
+
+    free (pack_texture_build (b->rgba, b->w, b->h, MIPS_FILTER_BOX, &size));
+}
+
+/* CPU mip chains, per kernel and spread over the workers, against glGenerateMipmap */
+static void
+bench_mips (const char *file)
+{
+    struct bench_mips_job jobs[BENCH_MIPS_RUNS];
+    Uint64 freq = SDL_GetPerformanceFrequency ();
+    struct asset asset;
+    unsigned char *rgba;
+    unsigned int id;
+    uint64_t size;
+    Uint64 start;
+    int w;
+    int h;
+    int n;
+
+    if (!asset_open (file, &asset))
+    {
+        return;
+    }
+    rgba = stbi_load_from_memory ((const unsigned char *) asset.data, (int) asset.len, &w, &h, &n, 4);
+    asset_close (&asset);
+    if (!rgba)
+    {
+        return;
+    }
+
+    printf ("Mip chain of '%s' (%dx%d, %d levels), ms per chain over %d runs:\n",
+            file, w, h, mips_level_count (w, h), BENCH_MIPS_RUNS);
+
+    for (int k = MIPS_SCALAR; k <= (int) g__mips_kernel_best; k++)
+    {
+        g__mips_kernel = k;
+        start = SDL_GetPerformanceCounter ();
+        for (int i = 0; i < BENCH_MIPS_RUNS; i++)
+        {
+            free (pack_texture_build (rgba, w, h, MIPS_FILTER_BOX, &size));
+        }
+        printf ("  box, %-18s %8.3f\n", mips_kernel_name (k),
+                (SDL_GetPerformanceCounter () - start) * 1000.0 / freq / BENCH_MIPS_RUNS);
+    }
+    g__mips_kernel = g__mips_kernel_best;
+
+    start = SDL_GetPerformanceCounter ();
+    for (int i = 0; i < BENCH_MIPS_RUNS; i++)
+    {
+        free (pack_texture_build (rgba, w, h, MIPS_FILTER_SRGB, &size));
+    }
+    printf ("  srgb, scalar            %8.3f\n", (SDL_GetPerformanceCounter () - start) * 1000.0 / freq / BENCH_MIPS_RUNS);
+
+    start = SDL_GetPerformanceCounter ();
+    for (int i = 0; i < BENCH_MIPS_RUNS; i++)
+    {
+        jobs[i] = (struct bench_mips_job) { { _bench_mips_job, &jobs[i] }, rgba, w, h };
+        workers_submit (&jobs[i].job);
+    }
+    for (int i = 0; i < BENCH_MIPS_RUNS; i++)
+    {
+        job_wait (&jobs[i].job);
+    }
+    printf ("  box, %s x %d workers %8.3f\n", mips_kernel_name (g__mips_kernel), g__workers.count,
+            (SDL_GetPerformanceCounter () - start) * 1000.0 / freq / BENCH_MIPS_RUNS);
+
+    GLCALL (glGenTextures (1, &id));
+    GLCALL (glBindTexture (GL_TEXTURE_2D, id));
+    GLCALL (glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba));
+    glFinish ();
+
+    start = SDL_GetPerformanceCounter ();
+    for (int i = 0; i < BENCH_MIPS_RUNS; i++)
+    {
+        GLCALL (glGenerateMipmap (GL_TEXTURE_2D));
+    }
+    glFinish ();
+    printf ("  glGenerateMipmap        %8.3f\n", (SDL_GetPerformanceCounter () - start) * 1000.0 / freq / BENCH_MIPS_RUNS);
+
+    GLCALL (glDeleteTextures (1, &id));
+    gls_invalidate ();
+    stbi_image_free (rgba);
+}
+
+/**
+ * Renders every scene (and every variation of it) back to back with no
+ * vsync and no frame pacing, recording the CPU time of each frame. The
+ * clock runs in virtual time and restarts for each scene, so every run
+ * renders exactly the same frames.
+ */
+static void
+bench_run (struct context *ctx, int frames, char *json_file)
+{
+    struct bench_scene
+    {
+        char *name;
+        enum state state;
+        int variation;
+        bool instanced;
+    } scenes[STATE_RENDER_MAX * 10];
+    struct bench_result results[LEN (scenes)] = {0};
+    Uint64 freq = SDL_GetPerformanceFrequency ();
+    int scene_count = 0;
+    int result_count = 0;
+
+    scenes[scene_count++] = (struct bench_scene) { "square", STATE_RENDER_SQUARE, -1 };
+    scenes[scene_count++] = (struct bench_scene) { "triangle", STATE_RENDER_TRIANGLE, -1 };
+    for (int i = 0; i < (int) LEN (g__texture_variants); i++) scenes[scene_count++] = (struct bench_scene) { "texture", STATE_RENDER_TEXTURE, i };
+    for (int i = 0; i < 9; i++) scenes[scene_count++] = (struct bench_scene) { "cube", STATE_RENDER_CUBE, i, false };
+    for (int i = 0; i < 9; i++) scenes[scene_count++] = (struct bench_scene) { "cube-inst", STATE_RENDER_CUBE, i, true };
+    for (int i = 0; i < ctx->stress_count_len; i++)
+    {
+        /* variation is the object count */
+        scenes[scene_count++] = (struct bench_scene) { "stress", STATE_RENDER_STRESS, ctx->stress_counts[i], true };
+    }
+
+    printf ("Benchmark: %d scenes x %d frames (%s)\n", scene_count, frames, glGetString (GL_RENDERER));
+    ctx->frame.bench = true;
+
+    /* measure rendering, not shader compilation: one frame of each scene submits the variants it uses */
+    for (int i = 0; i < scene_count; i++)
+    {
+        if (scenes[i].state != STATE_RENDER_STRESS)
+        {
+            ctx->frame.state = scenes[i].state;
+            ctx->frame.variation = scenes[i].variation;
+            ctx->frame.instanced = scenes[i].instanced;
+            render_frame (ctx, &ctx->frame);
+        }
+    }
+    programs_wait_all (ctx);
+    texture_stream_wait_all ();
+    bench_mips (SETUP_ASSET (BRICKS));
+
+    frame_clock_init (&ctx->frame.clock, BENCH_STEP_SECS);
+
+    for (int i = 0; i < scene_count && g__running; i++)
+    {
+        struct bench_scene *scene = &scenes[i];
+        struct bench_result *r = &results[result_count++];
+
+        if (scene->variation >= 0)
+        {
+            snprintf (r->name, sizeof (r->name), "%s/%d", scene->name, scene->variation);
+        }
+        else
+        {
+            snprintf (r->name, sizeof (r->name), "%s", scene->name);
+        }
+
+        r->frame_ms = malloc (frames * sizeof (double));
+        ASSERT (r->frame_ms != NULL);
+
+        ctx->frame.state = scene->state;
+        ctx->frame.variation = scene->variation;
+        ctx->frame.instanced = scene->instanced;
+        frame_clock_reset (&ctx->frame.clock);
+
+        if (scene->state == STATE_RENDER_STRESS)
+        {
+            scene_generate (&ctx->scene, scene->variation, ctx->scene.seed, ctx->scene.distribution);
+            stress_camera (&ctx->render_targets[STATE_RENDER_STRESS]);
+            r->objects = scene->variation;
+        }
+
+        for (int f = -BENCH_WARMUP_FRAMES; f < frames && g__running; f++)
+        {
+            Uint64 start = SDL_GetPerformanceCounter ();
+            unsigned long draw_calls = g__draw_calls;
+            unsigned long issued, skipped;
+            unsigned long issued_after, skipped_after;
+
+            gls_totals (&issued, &skipped);
+
+            if (f == 0)
+            {
+                memset (&ctx->scene.stats, 0, sizeof (ctx->scene.stats));
+            }
+
+            handle_input (ctx);
+            frame_clock_tick (&ctx->frame.clock);
+            render_frame (ctx, &ctx->frame);
+            SDL_GL_SwapWindow (ctx->window);
+
+            if (f >= 0)
+            {
+                r->frame_ms[r->frames++] = (SDL_GetPerformanceCounter () - start) * 1000.0 / freq;
+                r->draw_calls += g__draw_calls - draw_calls;
+
+                gls_totals (&issued_after, &skipped_after);
+                r->state_calls += issued_after - issued;
+                r->state_calls_skipped += skipped_after - skipped;
+            }
         }
 
+        if (scene->state == STATE_RENDER_STRESS)
+        {
+            struct scene_stats *st = &ctx->scene.stats;
+            int n = st->frames ? st->frames : 1;
+
+            r->update_ms = st->update_ms / n;
+            r->cull_ms = st->cull_ms / n;
+            r->submit_ms = st->submit_ms / n;
+            r->visible = st->visible / n;
+        }
+
+        bench_summarise (r);
+    }
+
+    bench_print (results, result_count);
+
+    if (json_file)
+    {
+        FILE *fp = strcmp (json_file, "-") == 0 ? stdout : fopen (json_file, "w");
+
+        if (fp)
+        {
+            bench_write_json (fp, results, result_count, g__startup_ms, g__textures.vram_bytes);
+            if (fp != stdout) fclose (fp);
+        }
+        else
+        {
+            LOG_ERROR ("Failed to open '%s' for writing", json_file);
+        }
+    }
+
+    for (int i = 0; i < result_count; i++)
+    {
+        free (results[i].frame_ms);
+    }
+}
+
+int
+main (int c, char **v)
+{
+    struct context ctx = {0};
+    int bench_frames = 0;
+    double step_secs = 0.0;
+    bool single_thread = false;
+    bool program_cache = true;
+    bool texture_cache = true;
+    bool pixel_buffers = true;
+    enum mips_filter mip_filter = MIPS_FILTER_BOX;
+    bool compress = true;
+    bool hot_reload = true;
+    char *asset_dir = NULL;     // --assets . to edit shaders in place
+    char *pack_file = "assets.pack";
+    Uint64 setup_start;
+    unsigned int seed = 1;
+    enum scene_distribution distribution = SCENE_UNIFORM;
+    char *json_file = NULL;
+
+    ctx.scene.max_speed = 2.0f;
+    ctx.scene.texture1_ratio = 0.5f;
+
+    for (int i = 1; i < c; i++)
+    {
+        if (strcmp (v[i], "--bench") == 0)
+        {
+            bench_frames = 500;
+            if (i + 1 < c && v[i + 1][0] != '-')
+            {
+                bench_frames = atoi (v[++i]);
+            }
+            if (bench_frames <= 0)
+            {
+                LOG_ERROR ("--bench wants a frame count above 0, got '%s'", v[i]);
+                return 1;
+            }
+        }
+        else if (strcmp (v[i], "--json") == 0 && i + 1 < c)
+        {
+            json_file = v[++i];
+        }
+        else if (strcmp (v[i], "--stress") == 0 && i + 1 < c)
+        {
+            /* comma separated object counts, the benchmark runs each */
+            for (char *n = strtok (v[++i], ","); n && ctx.stress_count_len < STRESS_MAX_COUNTS; n = strtok (NULL, ","))
+            {
+                int count = atoi (n);
+
+                if (count < 1)
+                {
+                    LOG_ERROR ("--stress wants object counts above 0, got '%s'", n);
+                    return 1;
+                }
+                ctx.stress_counts[ctx.stress_count_len++] = count;
+            }
+        }
+        else if (strcmp (v[i], "--seed") == 0 && i + 1 < c)
+        {
+            seed = strtoul (v[++i], NULL, 10);
+        }
+        else if (strcmp (v[i], "--distribution") == 0 && i + 1 < c)
+        {
+            distribution = scene_distribution_parse (v[++i]);
+            if (distribution == SCENE_DISTRIBUTION_MAX)
+            {
+                LOG_ERROR ("--distribution wants uniform, shell or grid, got '%s'", v[i]);
+                return 1;
+            }
+        }
+        else if (strcmp (v[i], "--max-speed") == 0 && i + 1 < c)
+        {
+            ctx.scene.max_speed = atof (v[++i]);
+            if (ctx.scene.max_speed < 0.0f)
+            {
+                LOG_ERROR ("--max-speed wants a speed of 0 rad/s or more, got '%s'", v[i]);
+                return 1;
+            }
+        }
+        else if (strcmp (v[i], "--texture-ratio") == 0 && i + 1 < c)
+        {
+            ctx.scene.texture1_ratio = atof (v[++i]);
+            if (ctx.scene.texture1_ratio < 0.0f || ctx.scene.texture1_ratio > 1.0f)
+            {
+                LOG_ERROR ("--texture-ratio wants a fraction from 0 to 1, got '%s'", v[i]);
+                return 1;
+            }
+        }
+        else if (strcmp (v[i], "--no-program-cache") == 0)
+        {
+            program_cache = false;
+        }
+        else if (strcmp (v[i], "--no-texture-cache") == 0)
+        {
+            texture_cache = false;
+        }
+        else if (strcmp (v[i], "--srgb-mips") == 0)
+        {
+            mip_filter = MIPS_FILTER_SRGB;
+        }
+        else if (strcmp (v[i], "--no-bc") == 0)
+        {
+            compress = false;
+        }
+        else if (strcmp (v[i], "--no-pbo") == 0)
+        {
+            pixel_buffers = false;
+        }
+        else if (strcmp (v[i], "--assets") == 0 && i + 1 < c)
+        {
+            asset_dir = v[++i];
+        }
+        else if (strcmp (v[i], "--pack") == 0 && i + 1 < c)
+        {
+            pack_file = v[++i];
+        }
+        else if (strcmp (v[i], "--no-hot-reload") == 0)
+        {
+            hot_reload = false;
+        }
+        else if (strcmp (v[i], "--single-thread") == 0)
+        {
+            single_thread = true;
+        }
+        else if (strcmp (v[i], "--fixed-step") == 0)
+        {
+            step_secs = BENCH_STEP_SECS;
+            if (i + 1 < c && v[i + 1][0] != '-')
+            {
+                double hz = atof (v[++i]);
+
+                if (hz <= 0.0)
+                {
+                    LOG_ERROR ("--fixed-step wants a rate above 0 Hz, got '%s'", v[i]);
+                    return 1;
+                }
+                step_secs = 1.0 / hz;
+            }
+        }
+        else
+        {
+            printf ("Usage: %s [--bench [frames]] [--json <file|->] [--fixed-step [hz]] [--single-thread]\n"
+                    "          [--stress <count[,count...]>] [--seed <n>] [--distribution uniform|shell|grid]\n"
+                    "          [--max-speed <rad/s>] [--texture-ratio <0-1>]\n"
+                    "          [--no-program-cache] [--no-texture-cache] [--no-pbo] [--srgb-mips] [--no-bc]\n"
+                    "          [--no-hot-reload] [--assets <dir>] [--pack <file>]\n", v[0]);
+            return 1;
+        }
+    }
+
+    init (&ctx, bench_frames > 0);
+
+    GLCALL (glViewport (0, 0, WINDOW_WIDTH_PX, WINDOW_HEIGHT_PX));
+    camera_init ();
+
+    setup_start = SDL_GetPerformanceCounter ();
+    workers_start (0);
+    aio_init ();
+    asset_init (asset_dir);
+    pack_open (pack_file);
+    asset_prefetch (g__setup_assets, LEN (g__setup_assets));
+    progcache_init (program_cache);
+    texcache_init (texture_cache);
+    mips_init ();
+    texture_stream_init (mip_filter, compress);
+    pbo_init (pixel_buffers);
+    shader_cache_begin ();
+
+    /**
+     * +-------------------- +
+     * |  VAO 1              |          +-------------------------+
+     * |                     |          |  VBO 1                  |
+     * | attribute pointer 0 -----------> pos[0] pos[1] .. pos[n] |
+     * | attribute pointer 1 |          +---|------|--------------+
+     * |                     |              +------+
+     * |                     |               stride
+     * | element buffer obj ------+
+     * +---------------------+    |     +---------+
+     *                            |     |  EBO 1  |
+     *                            +-----> indices |
+     *                                  +---------+
+     */
+    square_setup (&ctx.render_targets[STATE_RENDER_SQUARE]);
+    triangle_setup (&ctx.render_targets[STATE_RENDER_TRIANGLE]);
+    texture_setup (&ctx.render_targets[STATE_RENDER_TEXTURE]);
+    cube_setup (&ctx.render_targets[STATE_RENDER_CUBE]);
+
+    {
+        int capacity = 0;
+        int count = ctx.stress_count_len > 0 ? ctx.stress_counts[0] : STRESS_DEFAULT;
+
+        for (int i = 0; i < ctx.stress_count_len; i++)
+        {
+            if (ctx.stress_counts[i] > capacity) capacity = ctx.stress_counts[i];
+        }
+        if (count > capacity) capacity = count;
+
+        scene_generate (&ctx.scene, count, seed, distribution);
+        stress_setup (&ctx.render_targets[STATE_RENDER_STRESS], &ctx.render_targets[STATE_RENDER_CUBE], &ctx.scene, capacity);
+        stress_camera (&ctx.render_targets[STATE_RENDER_STRESS]);
+    }
+
+    shader_cache_end ();
+    gls_invalidate ();
+    GLCHECK ("setup");
+
+    g__startup_ms = (SDL_GetPerformanceCounter () - setup_start) * 1000.0 / SDL_GetPerformanceFrequency ();
+    printf ("Setup took %.2f ms\n", g__startup_ms);
+    progcache_report ();
+    asset_report ();
+
+    frame_clock_init (&ctx.frame.clock, step_secs);
+    g__running = true;
+
+    if (bench_frames > 0)
+    {
+        bench_run (&ctx, bench_frames, json_file);
+        g__running = false;
+    }
+
+    /* only files in the override directory can change under us */
+    if (g__running && hot_reload && asset_override_dir ())
+    {
+        hot_reload_start (&ctx);
+    }
+
+    if (g__running && !single_thread)
+    {
+        render_thread_start (&ctx);
+
+        while (g__running)
+        {
+            handle_input (&ctx);
+            frame_clock_tick (&ctx.frame.clock);
+            render_thread_submit (&ctx.render_thread, &ctx.frame);
+        }
+
+        render_thread_stop (&ctx);
+    }
+
+    while (g__running)
+    {
+        pacer_begin_frame (&ctx.pacer);
+        frame_clock_tick (&ctx.frame.clock);
+        handle_input (&ctx);
+        render_frame (&ctx, &ctx.frame);
+
         SDL_GL_SwapWindow (ctx.window);
-        SDL_Delay (FRAME_TIME_MS);
+        pacer_end_frame (&ctx.pacer);
     }
 
+    hot_reload_stop (&ctx);
+    texture_stream_shutdown ();
+    pbo_shutdown ();
+    asset_shutdown ();
+    aio_shutdown ();
+    progcache_shutdown ();
+    workers_stop ();
+    pack_close ();
+    scene_free (&ctx.scene);
     cleanup (&ctx);
 
     return 0;
 }
-
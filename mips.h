@@ -0,0 +1,283 @@
+#ifndef _MIPS_
+#define _MIPS_
+
+#include <math.h>
+
+/**
+ * CPU mip chain generation for RGBA8 images, shared by the runtime and
+ * tools/pack.c so a packed texture and a cached one come out the same.
+ *
+ * Each level is a 2x2 box filter of the one above; an odd last row or
+ * column is averaged with itself. The box filter has SSE2 and AVX2
+ * kernels, picked at runtime by mips_init(), which all give exactly the
+ * scalar result. MIPS_FILTER_SRGB averages the colour channels in linear
+ * light instead (alpha stays linear), which keeps bright/dark detail from
+ * going muddy in the small levels; it is scalar only.
+ */
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MIPS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MIPS_TARGET_AVX2
+#else
+#define MIPS_TARGET_AVX2 __attribute__ ((target ("avx2")))
+#endif
+#endif
+
+enum mips_filter
+{
+    MIPS_FILTER_BOX = 0,
+    MIPS_FILTER_SRGB,
+    MIPS_FILTER_MAX
+};
+
+enum mips_kernel
+{
+    MIPS_SCALAR = 0,
+    MIPS_SSE2,
+    MIPS_AVX2,
+    MIPS_KERNEL_MAX
+};
+
+static inline const char *
+mips_kernel_name (enum mips_kernel k)
+{
+    switch (k)
+    {
+        case MIPS_SCALAR: return "scalar";
+        case MIPS_SSE2: return "sse2";
+        case MIPS_AVX2: return "avx2";
+        default: return "???";
+    }
+}
+
+/* Best kernel the CPU has, set by mips_init(); may be lowered to compare */
+static enum mips_kernel g__mips_kernel = MIPS_SCALAR;
+static enum mips_kernel g__mips_kernel_best = MIPS_SCALAR;
+
+static float g__mips_to_linear[256];
+static unsigned char g__mips_to_srgb[4096];
+
+static inline int
+mips_level_count (int w, int h)
+{
+    int levels = 1;
+
+    while (w > 1 || h > 1)
+    {
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+        levels++;
+    }
+
+    return levels;
+}
+
+static inline enum mips_kernel
+_mips_detect (void)
+{
+#if defined(MIPS_X86) && defined(_MSC_VER)
+    int info[4];
+    bool sse2;
+    bool avx2 = false;
+
+    __cpuid (info, 1);
+    sse2 = (info[3] & (1 << 26)) != 0;
+
+    /* AVX needs the OS to save the YMM registers too */
+    if ((info[2] & (1 << 27)) && (_xgetbv (0) & 6) == 6)
+    {
+        __cpuidex (info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+
+    return avx2 ? MIPS_AVX2 : sse2 ? MIPS_SSE2 : MIPS_SCALAR;
+#elif defined(MIPS_X86)
+    __builtin_cpu_init ();
+
+    return __builtin_cpu_supports ("avx2") ? MIPS_AVX2 : __builtin_cpu_supports ("sse2") ? MIPS_SSE2 : MIPS_SCALAR;
+#else
+    return MIPS_SCALAR;
+#endif
+}
+
+static inline void
+mips_init (void)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        float c = i / 255.0f;
+
+        g__mips_to_linear[i] = c <= 0.04045f ? c / 12.92f : powf ((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for (int i = 0; i < 4096; i++)
+    {
+        float l = i / 4095.0f;
+        float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf (l, 1.0f / 2.4f) - 0.055f;
+
+        g__mips_to_srgb[i] = (unsigned char) (c * 255.0f + 0.5f);
+    }
+
+    g__mips_kernel_best = _mips_detect ();
+    g__mips_kernel = g__mips_kernel_best;
+}
+
+/* One output row, pixels [x, dw) of it */
+static inline void
+_mips_row_box (const unsigned char *row0, const unsigned char *row1, int w, unsigned char *dst, int x, int dw)
+{
+    for (; x < dw; x++)
+    {
+        int x0 = (x * 2 < w ? x * 2 : w - 1) * 4;
+        int x1 = (x * 2 + 1 < w ? x * 2 + 1 : w - 1) * 4;
+
+        for (int c = 0; c < 4; c++)
+        {
+            int sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+
+            dst[x * 4 + c] = (unsigned char) ((sum + 2) >> 2);
+        }
+    }
+}
+
+static inline void
+_mips_row_srgb (const unsigned char *row0, const unsigned char *row1, int w, unsigned char *dst, int dw)
+{
+    for (int x = 0; x < dw; x++)
+    {
+        int x0 = (x * 2 < w ? x * 2 : w - 1) * 4;
+        int x1 = (x * 2 + 1 < w ? x * 2 + 1 : w - 1) * 4;
+        int alpha = row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3];
+
+        for (int c = 0; c < 3; c++)
+        {
+            float sum = g__mips_to_linear[row0[x0 + c]] + g__mips_to_linear[row0[x1 + c]] +
+                        g__mips_to_linear[row1[x0 + c]] + g__mips_to_linear[row1[x1 + c]];
+
+            dst[x * 4 + c] = g__mips_to_srgb[(int) (sum * (4095.0f / 4.0f) + 0.5f)];
+        }
+        dst[x * 4 + 3] = (unsigned char) ((alpha + 2) >> 2);
+    }
+}
+
+#ifdef MIPS_X86
+
+/* 4 source pixels (16 bytes) of each row -> the 4 channel sums of 2 output pixels as 16-bit lanes */
+static inline __m128i
+_mips_sum_sse2 (__m128i a, __m128i b)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    __m128i lo = _mm_add_epi16 (_mm_unpacklo_epi8 (a, zero), _mm_unpacklo_epi8 (b, zero));
+    __m128i hi = _mm_add_epi16 (_mm_unpackhi_epi8 (a, zero), _mm_unpackhi_epi8 (b, zero));
+
+    lo = _mm_add_epi16 (lo, _mm_srli_si128 (lo, 8));
+    hi = _mm_add_epi16 (hi, _mm_srli_si128 (hi, 8));
+
+    return _mm_unpacklo_epi64 (lo, hi);
+}
+
+/* Output pixels [0, n) of the row, 4 at a time; returns how far it got */
+static inline int
+_mips_row_sse2 (const unsigned char *row0, const unsigned char *row1, unsigned char *dst, int n)
+{
+    const __m128i round = _mm_set1_epi16 (2);
+    int x = 0;
+
+    for (; x + 4 <= n; x += 4)
+    {
+        const unsigned char *s0 = row0 + x * 8;
+        const unsigned char *s1 = row1 + x * 8;
+        __m128i a = _mips_sum_sse2 (_mm_loadu_si128 ((const __m128i *) s0), _mm_loadu_si128 ((const __m128i *) s1));
+        __m128i b = _mips_sum_sse2 (_mm_loadu_si128 ((const __m128i *) (s0 + 16)),
+                                    _mm_loadu_si128 ((const __m128i *) (s1 + 16)));
+
+        a = _mm_srli_epi16 (_mm_add_epi16 (a, round), 2);
+        b = _mm_srli_epi16 (_mm_add_epi16 (b, round), 2);
+        _mm_storeu_si128 ((__m128i *) (dst + x * 4), _mm_packus_epi16 (a, b));
+    }
+
+    return x;
+}
+
+/* Same as _mips_sum_sse2 per 128-bit lane: 8 source pixels -> output pixels 0,1 | 2,3 */
+MIPS_TARGET_AVX2 static inline __m256i
+_mips_sum_avx2 (__m256i a, __m256i b)
+{
+    __m256i zero = _mm256_setzero_si256 ();
+    __m256i lo = _mm256_add_epi16 (_mm256_unpacklo_epi8 (a, zero), _mm256_unpacklo_epi8 (b, zero));
+    __m256i hi = _mm256_add_epi16 (_mm256_unpackhi_epi8 (a, zero), _mm256_unpackhi_epi8 (b, zero));
+
+    lo = _mm256_add_epi16 (lo, _mm256_srli_si256 (lo, 8));
+    hi = _mm256_add_epi16 (hi, _mm256_srli_si256 (hi, 8));
+
+    return _mm256_unpacklo_epi64 (lo, hi);
+}
+
+MIPS_TARGET_AVX2 static inline int
+_mips_row_avx2 (const unsigned char *row0, const unsigned char *row1, unsigned char *dst, int n)
+{
+    const __m256i round = _mm256_set1_epi16 (2);
+    int x = 0;
+
+    for (; x + 8 <= n; x += 8)
+    {
+        const unsigned char *s0 = row0 + x * 8;
+        const unsigned char *s1 = row1 + x * 8;
+        __m256i a = _mips_sum_avx2 (_mm256_loadu_si256 ((const __m256i *) s0),
+                                    _mm256_loadu_si256 ((const __m256i *) s1));
+        __m256i b = _mips_sum_avx2 (_mm256_loadu_si256 ((const __m256i *) (s0 + 32)),
+                                    _mm256_loadu_si256 ((const __m256i *) (s1 + 32)));
+
+        a = _mm256_srli_epi16 (_mm256_add_epi16 (a, round), 2);
+        b = _mm256_srli_epi16 (_mm256_add_epi16 (b, round), 2);
+
+        /* packus works per lane: 0 1 4 5 | 2 3 6 7 -> 0 1 2 3 | 4 5 6 7 */
+        _mm256_storeu_si256 ((__m256i *) (dst + x * 4),
+                             _mm256_permute4x64_epi64 (_mm256_packus_epi16 (a, b), 0xd8));
+    }
+
+    return x;
+}
+
+#endif
+
+/* dst must hold max(w/2,1) * max(h/2,1) pixels */
+static inline void
+mips_downsample_rgba8 (const unsigned char *src, int w, int h, unsigned char *dst, enum mips_filter filter)
+{
+    int dw = w > 1 ? w / 2 : 1;
+    int dh = h > 1 ? h / 2 : 1;
+
+    for (int y = 0; y < dh; y++)
+    {
+        const unsigned char *row0 = src + (size_t) (y * 2 < h ? y * 2 : h - 1) * w * 4;
+        const unsigned char *row1 = src + (size_t) (y * 2 + 1 < h ? y * 2 + 1 : h - 1) * w * 4;
+        unsigned char *out = dst + (size_t) y * dw * 4;
+        int x = 0;
+
+        if (filter == MIPS_FILTER_SRGB)
+        {
+            _mips_row_srgb (row0, row1, w, out, dw);
+            continue;
+        }
+
+#ifdef MIPS_X86
+        /* only output pixels whose two source columns both exist */
+        if (g__mips_kernel == MIPS_AVX2)
+        {
+            x = _mips_row_avx2 (row0, row1, out, w / 2);
+        }
+        if (g__mips_kernel >= MIPS_SSE2)
+        {
+            x += _mips_row_sse2 (row0 + x * 8, row1 + x * 8, out + x * 4, w / 2 - x);
+        }
+#endif
+
+        _mips_row_box (row0, row1, w, out, x, dw);
+    }
+}
+
+#endif
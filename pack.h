@@ -0,0 +1,112 @@
+#ifndef _PACK_
+#define _PACK_
+
+#include "packformat.h"
+
+/**
+ * Read side of the asset pack (see packformat.h, built by tools/pack.c).
+ *
+ * The whole pack is mapped once at startup; lookups hash the name and
+ * probe the index in place and payloads are used straight out of the
+ * mapping, so nothing is read or copied until it is touched.
+ */
+
+struct pack
+{
+    struct file_view view;
+    const struct pack_header *header;
+    const struct pack_entry *index;
+};
+
+static struct pack g__pack;
+
+static bool
+pack_open (const char *path)
+{
+    struct pack *p = &g__pack;
+    const struct pack_header *h;
+
+    memset (p, 0, sizeof (*p));
+
+    if (!file_view_open (path, &p->view))
+    {
+        return false;
+    }
+
+    h = p->view.data;
+    if (p->view.len < sizeof (*h) || h->magic != PACK_MAGIC || h->version != PACK_VERSION ||
+        h->file_size != p->view.len || (h->index_capacity & (h->index_capacity - 1)) != 0 ||
+        h->index_offset + (uint64_t) h->index_capacity * sizeof (struct pack_entry) > p->view.len)
+    {
+        LOG_ERROR ("'%s' is not a valid pack, ignoring it", path);
+        file_view_close (&p->view);
+        return false;
+    }
+
+    p->header = h;
+    p->index = (const struct pack_entry *) ((const char *) p->view.data + h->index_offset);
+
+    printf ("Pack '%s': %u entries, %zu bytes\n", path, h->entry_count, p->view.len);
+
+    return true;
+}
+
+static void
+pack_close (void)
+{
+    if (g__pack.header)
+    {
+        file_view_close (&g__pack.view);
+    }
+
+    memset (&g__pack, 0, sizeof (g__pack));
+}
+
+/* NULL if there is no pack or the name isn't in it */
+static const struct pack_entry *
+pack_find (const char *name)
+{
+    struct pack *p = &g__pack;
+    uint64_t hash;
+    uint32_t mask;
+
+    if (!p->header || p->header->index_capacity == 0)
+    {
+        return NULL;
+    }
+
+    hash = pack_hash (name);
+    mask = p->header->index_capacity - 1;
+
+    for (uint32_t i = 0; i <= mask; i++)
+    {
+        const struct pack_entry *e = &p->index[(hash + i) & mask];
+
+        if (e->type == PACK_EMPTY)
+        {
+            break;
+        }
+        if (e->hash == hash && strncmp (e->name, name, PACK_NAME_LEN) == 0)
+        {
+            /* never trust offsets into a mapping */
+            return e->offset + e->size <= p->view.len ? e : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/* Starts reading an entry's pages in the background */
+static void
+pack_prefetch (const struct pack_entry *e)
+{
+    file_view_prefetch (&g__pack.view, e->offset, e->size);
+}
+
+static const void *
+pack_data (const struct pack_entry *e)
+{
+    return (const char *) g__pack.view.data + e->offset;
+}
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef _PACKFORMAT_
+#define _PACKFORMAT_
+
+#include <stdint.h>
+#include "hash.h"
+#include "mips.h"
+#include "bc.h"
+#include "pixfmt.h"
+
+/**
+ * Asset pack layout, shared by tools/pack.c and pack.h.
+ *
+ *   pack_header
+ *   pack_entry[index_capacity]     open-addressed on hash_fnv1a(name)
+ *   payloads                       each starting on a PACK_ALIGN boundary
+ *
+ * A PACK_RAW payload is the file as it was (shader sources). A
+ * PACK_TEXTURE payload is a pack_texture followed by every mip level,
+ * already decoded and flipped the way texstream.h wants them, as RGBA8 or
+ * BC1/BC3 blocks (the runtime also narrows them to R8, RG8, RGB8 and
+ * RGB565 for the texture cache), so loading is just handing the levels to
+ * glTexImage2D or glCompressedTexImage2D. Entry offsets are
+ * from the start of the file, level offsets from the pack_texture, all
+ * integers little-endian. The texture cache (texcache.h) stores its
+ * files as a pack_texture too.
+ */
+
+#define PACK_MAGIC       0x4b434150u    // "PACK"
+#define PACK_VERSION     1
+#define PACK_ALIGN       64
+#define PACK_NAME_LEN    32
+#define PACK_MAX_LEVELS  16
+
+enum pack_type
+{
+    PACK_EMPTY = 0,     // free index slot
+    PACK_RAW,
+    PACK_TEXTURE
+};
+
+enum pack_format
+{
+    PACK_RGBA8 = 0,
+    PACK_BC1,           // opaque
+    PACK_BC3,           // with alpha
+    PACK_R8,            // grey
+    PACK_RG8,           // grey + alpha
+    PACK_RGB8,
+    PACK_RGB565,
+    PACK_FORMAT_MAX
+};
+
+static inline const char *
+pack_format_name (enum pack_format format)
+{
+    switch (format)
+    {
+        case PACK_RGBA8: return "rgba8";
+        case PACK_BC1: return "bc1";
+        case PACK_BC3: return "bc3";
+        case PACK_R8: return "r8";
+        case PACK_RG8: return "rg8";
+        case PACK_RGB8: return "rgb8";
+        case PACK_RGB565: return "rgb565";
+        default: return "???";
+    }
+}
+
+/* Bytes per pixel of the uncompressed formats, 0 for the block formats */
+static inline int
+pack_format_bytes (enum pack_format format)
+{
+    switch (format)
+    {
+        case PACK_RGBA8: return 4;
+        case PACK_R8: return 1;
+        case PACK_RG8: return 2;
+        case PACK_RGB8: return 3;
+        case PACK_RGB565: return 2;
+        default: return 0;
+    }
+}
+
+struct pack_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t index_capacity;    // power of two
+    uint64_t index_offset;
+    uint64_t file_size;
+};
+
+struct pack_entry
+{
+    uint64_t hash;
+    char name[PACK_NAME_LEN];
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct pack_texture
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+    uint32_t format;
+    uint64_t level_offset[PACK_MAX_LEVELS];
+    uint64_t level_size[PACK_MAX_LEVELS];
+};
+
+static inline uint64_t
+pack_hash (const char *name)
+{
+    return hash_fnv1a (name, strlen (name), HASH_FNV64_BASIS);
+}
+
+static inline uint64_t
+pack_level_size (enum pack_format format, int w, int h)
+{
+    switch (format)
+    {
+        case PACK_BC1: return bc_level_size (w, h, BC1_BLOCK_BYTES);
+        case PACK_BC3: return bc_level_size (w, h, BC3_BLOCK_BYTES);
+        default: return (uint64_t) w * h * pack_format_bytes (format);
+    }
+}
+
+/* Fills in the level table, returns the size of the whole block */
+static inline uint64_t
+_pack_texture_layout (struct pack_texture *tex, enum pack_format format, int w, int h)
+{
+    uint64_t pos = sizeof (*tex);
+
+    memset (tex, 0, sizeof (*tex));
+    tex->width = w;
+    tex->height = h;
+    tex->format = format;
+    tex->levels = mips_level_count (w, h);
+    if (tex->levels > PACK_MAX_LEVELS) tex->levels = PACK_MAX_LEVELS;
+
+    for (uint32_t i = 0; i < tex->levels; i++)
+    {
+        pos = (pos + PACK_ALIGN - 1) & ~(uint64_t) (PACK_ALIGN - 1);
+        tex->level_offset[i] = pos;
+        tex->level_size[i] = pack_level_size (format, w, h);
+        pos += tex->level_size[i];
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    return pos;
+}
+
+/**
+ * Builds an RGBA8 pack_texture followed by the full mip chain of an image
+ * in one malloc'd block, level offsets PACK_ALIGN aligned. Returns NULL
+ * if out of memory, otherwise free() it.
+ */
+static inline struct pack_texture *
+pack_texture_build (const unsigned char *rgba, int w, int h, enum mips_filter filter, uint64_t *size)
+{
+    struct pack_texture tex;
+    unsigned char *block;
+    int lw = w;
+    int lh = h;
+
+    *size = _pack_texture_layout (&tex, PACK_RGBA8, w, h);
+
+    block = calloc (1, *size);
+    if (!block)
+    {
+        return NULL;
+    }
+
+    memcpy (block, &tex, sizeof (tex));
+    memcpy (block + tex.level_offset[0], rgba, tex.level_size[0]);
+
+    /* each level straight from the one before it */
+    for (uint32_t i = 1; i < tex.levels; i++)
+    {
+        mips_downsample_rgba8 (block + tex.level_offset[i - 1], lw, lh, block + tex.level_offset[i], filter);
+        lw = lw > 1 ? lw / 2 : 1;
+        lh = lh > 1 ? lh / 2 : 1;
+    }
+
+    return (struct pack_texture *) block;
+}
+
+/**
+ * Converts every level of `src` to `format` into a new malloc'd block,
+ * NULL if out of memory. RGBA8 converts to anything; BC1/BC3 only back
+ * to RGBA8.
+ */
+static inline struct pack_texture *
+pack_texture_convert (const struct pack_texture *src, enum pack_format format, uint64_t *size)
+{
+    struct pack_texture tex;
+    unsigned char *block;
+
+    *size = _pack_texture_layout (&tex, format, src->width, src->height);
+    tex.levels = src->levels;
+
+    block = calloc (1, *size);
+    if (!block)
+    {
+        return NULL;
+    }
+
+    memcpy (block, &tex, sizeof (tex));
+
+    for (uint32_t i = 0; i < tex.levels; i++)
+    {
+        int lw = src->width >> i ? src->width >> i : 1;
+        int lh = src->height >> i ? src->height >> i : 1;
+        const unsigned char *in = (const unsigned char *) src + src->level_offset[i];
+        unsigned char *out = block + tex.level_offset[i];
+
+        if (format == (enum pack_format) src->format)
+        {
+            memcpy (out, in, tex.level_size[i]);
+        }
+        else if (src->format == PACK_RGBA8 && (format == PACK_BC1 || format == PACK_BC3))
+        {
+            bc_encode (in, lw, lh, format == PACK_BC1 ? BC1_BLOCK_BYTES : BC3_BLOCK_BYTES, out);
+        }
+        else if (src->format == PACK_RGBA8)
+        {
+            pixfmt_pack (in, (size_t) lw * lh, pack_format_bytes (format), format == PACK_RGB565, out);
+        }
+        else
+        {
+            bc_decode (in, lw, lh, src->format == PACK_BC1 ? BC1_BLOCK_BYTES : BC3_BLOCK_BYTES, out);
+        }
+    }
+
+    return (struct pack_texture *) block;
+}
+
+/* BC1 unless some pixel of the top level is not opaque */
+static inline enum pack_format
+pack_texture_bc_format (const struct pack_texture *tex)
+{
+    const unsigned char *rgba = (const unsigned char *) tex + tex->level_offset[0];
+
+    return bc_has_alpha (rgba, tex->width, tex->height) ? PACK_BC3 : PACK_BC1;
+}
+
+/**
+ * Writes an image as a pack_texture with its box-filtered mip chain at
+ * the current file position, which must be PACK_ALIGN aligned for the
+ * levels to be; block compressed if `compress`. Returns the bytes
+ * written, 0 on failure.
+ */
+static inline uint64_t
+pack_texture_write (FILE *out, const unsigned char *rgba, int w, int h, bool compress)
+{
+    uint64_t size;
+    struct pack_texture *tex = pack_texture_build (rgba, w, h, MIPS_FILTER_BOX, &size);
+    bool ok;
+
+    if (tex && compress)
+    {
+        struct pack_texture *bc = pack_texture_convert (tex, pack_texture_bc_format (tex), &size);
+
+        free (tex);
+        tex = bc;
+    }
+
+    ok = tex && fwrite (tex, 1, size, out) == size;
+    free (tex);
+
+    return ok ? size : 0;
+}
+
+#endif
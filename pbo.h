@@ -0,0 +1,183 @@
+#ifndef _PBO_
+#define _PBO_
+
+/**
+ * Ring of GL_PIXEL_UNPACK_BUFFERs for texture uploads.
+ *
+ * pbo_acquire() maps the next buffer for writing. Until it is handed
+ * back the mapping is plain memory, so the copy into it can run on a
+ * worker. pbo_submit() unmaps it and leaves it bound, which turns the
+ * data argument of glTexImage2D into an offset into the buffer, and the
+ * call returns without the driver copying anything; pbo_finish() unbinds
+ * and fences. A buffer is only mapped again once its fence has
+ * signalled, so one transfer can be in flight while the next buffer is
+ * being filled.
+ */
+
+#define PBO_RING_LEN  2
+#define PBO_WAIT_NS   1000000000ull
+
+struct pbo
+{
+    unsigned int id;
+    size_t capacity;
+    size_t size;
+    void *mapped;
+    GLsync fence;       // last transfer out of this buffer
+    bool busy;          // between pbo_acquire() and pbo_finish()
+};
+
+struct pbo_ring
+{
+    struct pbo buffers[PBO_RING_LEN];
+    unsigned int next;
+    bool enabled;
+
+    unsigned int uploads;
+    unsigned int stalls;    // next buffer was still in flight
+    uint64_t bytes;
+};
+
+static struct pbo_ring g__pbo;
+
+static void
+pbo_init (bool enabled)
+{
+    struct pbo_ring *r = &g__pbo;
+
+    memset (r, 0, sizeof (*r));
+
+    if (!enabled)
+    {
+        return;
+    }
+
+    for (int i = 0; i < PBO_RING_LEN; i++)
+    {
+        GLCALL (glGenBuffers (1, &r->buffers[i].id));
+    }
+
+    r->enabled = true;
+}
+
+/* True once the buffer's last transfer is done; waits up to `timeout_ns` */
+static bool
+_pbo_idle (struct pbo *b, GLuint64 timeout_ns)
+{
+    GLenum result;
+
+    if (!b->fence)
+    {
+        return true;
+    }
+
+    result = glClientWaitSync (b->fence, timeout_ns ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeout_ns);
+    if (result == GL_TIMEOUT_EXPIRED)
+    {
+        return false;
+    }
+
+    glDeleteSync (b->fence);
+    b->fence = NULL;
+
+    return true;
+}
+
+/**
+ * Maps the next buffer for `size` bytes. NULL if that buffer is still in
+ * use; `wait` blocks on its fence instead of giving up. A failed map
+ * turns the ring off, callers check g__pbo.enabled and upload directly.
+ */
+static struct pbo *
+pbo_acquire (size_t size, bool wait)
+{
+    struct pbo_ring *r = &g__pbo;
+    struct pbo *b = &r->buffers[r->next % PBO_RING_LEN];
+
+    if (!r->enabled || b->busy)
+    {
+        return NULL;
+    }
+
+    if (!_pbo_idle (b, wait ? PBO_WAIT_NS : 0))
+    {
+        r->stalls++;
+        return NULL;
+    }
+
+    GLCALL (glBindBuffer (GL_PIXEL_UNPACK_BUFFER, b->id));
+    if (size > b->capacity)
+    {
+        GLCALL (glBufferData (GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW));
+        b->capacity = size;
+    }
+
+    b->mapped = glMapBufferRange (GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    GLCALL (glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0));
+
+    if (!b->mapped)
+    {
+        LOG_ERROR ("Failed to map a %zu byte pixel buffer, uploading directly", size);
+        r->enabled = false;
+        return NULL;
+    }
+
+    b->size = size;
+    b->busy = true;
+    r->next++;
+
+    return b;
+}
+
+/* Returns false if the contents were lost while mapped; the upload has to use the source instead */
+static bool
+pbo_submit (struct pbo *b)
+{
+    GLboolean ok;
+
+    GLCALL (glBindBuffer (GL_PIXEL_UNPACK_BUFFER, b->id));
+    ok = glUnmapBuffer (GL_PIXEL_UNPACK_BUFFER);
+    b->mapped = NULL;
+
+    return ok == GL_TRUE;
+}
+
+static void
+pbo_finish (struct pbo *b)
+{
+    struct pbo_ring *r = &g__pbo;
+
+    GLCALL (glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0));
+    b->fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    b->busy = false;
+
+    r->uploads++;
+    r->bytes += b->size;
+}
+
+static void
+pbo_shutdown (void)
+{
+    struct pbo_ring *r = &g__pbo;
+
+    for (int i = 0; i < PBO_RING_LEN; i++)
+    {
+        struct pbo *b = &r->buffers[i];
+
+        if (b->id)
+        {
+            _pbo_idle (b, PBO_WAIT_NS);
+            GLCALL (glDeleteBuffers (1, &b->id));
+        }
+    }
+
+    if (r->uploads > 0)
+    {
+        printf ("Pixel buffers: %u uploads, %.2f MB, %u stalls on a busy buffer\n",
+                r->uploads, r->bytes / (1024.0 * 1024.0), r->stalls);
+    }
+
+    memset (r, 0, sizeof (*r));
+}
+
+#endif
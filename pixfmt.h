@@ -0,0 +1,179 @@
+#ifndef _PIXFMT_
+#define _PIXFMT_
+
+/**
+ * Packing RGBA8 pixels down to the narrower formats a texture can live
+ * in: R8, RG8, RGB8 and RGB565. The texture's swizzle mask fills the
+ * dropped channels back in on sampling, so shaders still see RGBA.
+ *
+ * The kernels use the same runtime dispatch as mips.h: R8, RG8 and RGB565
+ * are SSE2, RGB8 needs a byte shuffle and uses SSSE3 on CPUs that have
+ * AVX2 (which implies it). Every kernel gives exactly the scalar result.
+ */
+
+#include "mips.h"       // MIPS_X86, g__mips_kernel and the intrinsics
+
+/* 1 grey, 2 grey + alpha, 3 colour, 4 colour + alpha, going by the pixels rather than the file */
+static inline int
+pixfmt_channels (const unsigned char *rgba, size_t count)
+{
+    bool grey = true;
+    bool opaque = true;
+
+    for (size_t i = 0; i < count && (grey || opaque); i++)
+    {
+        const unsigned char *p = rgba + i * 4;
+
+        if (p[0] != p[1] || p[0] != p[2]) grey = false;
+        if (p[3] != 255) opaque = false;
+    }
+
+    return grey ? (opaque ? 1 : 2) : (opaque ? 3 : 4);
+}
+
+#ifdef MIPS_X86
+
+/* 32-bit lanes holding 16-bit values -> 16-bit lanes, without packs_epi32's signed saturation */
+static inline __m128i
+_pixfmt_narrow (__m128i a, __m128i b)
+{
+    a = _mm_srai_epi32 (_mm_slli_epi32 (a, 16), 16);
+    b = _mm_srai_epi32 (_mm_slli_epi32 (b, 16), 16);
+
+    return _mm_packs_epi32 (a, b);
+}
+
+static inline __m128i
+_pixfmt_565 (__m128i p)
+{
+    __m128i r = _mm_slli_epi32 (_mm_and_si128 (p, _mm_set1_epi32 (0xf8)), 8);
+    __m128i g = _mm_slli_epi32 (_mm_and_si128 (_mm_srli_epi32 (p, 8), _mm_set1_epi32 (0xfc)), 3);
+    __m128i b = _mm_srli_epi32 (_mm_and_si128 (_mm_srli_epi32 (p, 16), _mm_set1_epi32 (0xf8)), 3);
+
+    return _mm_or_si128 (_mm_or_si128 (r, g), b);
+}
+
+/* Each returns how many pixels it did; the scalar loop finishes the rest */
+static inline size_t
+_pixfmt_r8_sse2 (const unsigned char *src, size_t n, unsigned char *dst)
+{
+    const __m128i mask = _mm_set1_epi32 (0xff);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m128i *s = (const __m128i *) (src + i * 4);
+        __m128i a = _mm_packs_epi32 (_mm_and_si128 (_mm_loadu_si128 (s), mask), _mm_and_si128 (_mm_loadu_si128 (s + 1), mask));
+        __m128i b = _mm_packs_epi32 (_mm_and_si128 (_mm_loadu_si128 (s + 2), mask), _mm_and_si128 (_mm_loadu_si128 (s + 3), mask));
+
+        _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16 (a, b));
+    }
+
+    return i;
+}
+
+/* R and A of a grey + alpha image */
+static inline size_t
+_pixfmt_rg8_sse2 (const unsigned char *src, size_t n, unsigned char *dst)
+{
+    const __m128i mask = _mm_set1_epi32 (0xff);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i *s = (const __m128i *) (src + i * 4);
+        __m128i a = _mm_loadu_si128 (s);
+        __m128i b = _mm_loadu_si128 (s + 1);
+
+        a = _mm_or_si128 (_mm_and_si128 (a, mask), _mm_slli_epi32 (_mm_srli_epi32 (a, 24), 8));
+        b = _mm_or_si128 (_mm_and_si128 (b, mask), _mm_slli_epi32 (_mm_srli_epi32 (b, 24), 8));
+        _mm_storeu_si128 ((__m128i *) (dst + i * 2), _pixfmt_narrow (a, b));
+    }
+
+    return i;
+}
+
+static inline size_t
+_pixfmt_rgb565_sse2 (const unsigned char *src, size_t n, unsigned char *dst)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i *s = (const __m128i *) (src + i * 4);
+
+        _mm_storeu_si128 ((__m128i *) (dst + i * 2),
+                          _pixfmt_narrow (_pixfmt_565 (_mm_loadu_si128 (s)), _pixfmt_565 (_mm_loadu_si128 (s + 1))));
+    }
+
+    return i;
+}
+
+#ifdef _MSC_VER
+#define PIXFMT_TARGET_SSSE3
+#else
+#define PIXFMT_TARGET_SSSE3 __attribute__ ((target ("ssse3")))
+#endif
+
+/* 4 pixels -> 12 bytes per store; stops 2 pixels early so the 16 byte store stays inside dst */
+PIXFMT_TARGET_SSSE3 static inline size_t
+_pixfmt_rgb8_ssse3 (const unsigned char *src, size_t n, unsigned char *dst)
+{
+    const __m128i shuffle = _mm_setr_epi8 (0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t i = 0;
+
+    for (; i + 6 <= n; i += 4)
+    {
+        __m128i p = _mm_loadu_si128 ((const __m128i *) (src + i * 4));
+
+        _mm_storeu_si128 ((__m128i *) (dst + i * 3), _mm_shuffle_epi8 (p, shuffle));
+    }
+
+    return i;
+}
+
+#endif
+
+/* `bytes` per pixel out: 1 R8, 2 RG8 (or RGB565 if `rgb565`), 3 RGB8, 4 RGBA8 */
+static inline void
+pixfmt_pack (const unsigned char *src, size_t n, int bytes, bool rgb565, unsigned char *dst)
+{
+    size_t i = 0;
+
+#ifdef MIPS_X86
+    if (g__mips_kernel >= MIPS_SSE2)
+    {
+        if (bytes == 1) i = _pixfmt_r8_sse2 (src, n, dst);
+        else if (bytes == 2 && rgb565) i = _pixfmt_rgb565_sse2 (src, n, dst);
+        else if (bytes == 2) i = _pixfmt_rg8_sse2 (src, n, dst);
+    }
+    if (bytes == 3 && g__mips_kernel == MIPS_AVX2)
+    {
+        i = _pixfmt_rgb8_ssse3 (src, n, dst);
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        const unsigned char *p = src + i * 4;
+        unsigned char *out = dst + i * bytes;
+
+        if (rgb565)
+        {
+            uint16_t v = (uint16_t) (((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3));
+
+            memcpy (out, &v, 2);
+        }
+        else if (bytes == 2)
+        {
+            out[0] = p[0];
+            out[1] = p[3];
+        }
+        else
+        {
+            memcpy (out, p, bytes);
+        }
+    }
+}
+
+#endif
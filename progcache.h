@@ -0,0 +1,312 @@
+#ifndef _PROGCACHE_
+#define _PROGCACHE_
+
+#include "hash.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define progcache_mkdir(dir) _mkdir (dir)
+#else
+#include <sys/stat.h>
+#define progcache_mkdir(dir) mkdir (dir, 0755)
+#endif
+
+/**
+ * On-disk cache of linked program binaries.
+ *
+ * Keyed by a hash of the vertex and fragment source plus the GL vendor,
+ * renderer and version strings, so a driver update or a different GPU
+ * never sees a stale binary. Binaries the driver rejects are treated as
+ * misses and overwritten after the normal compile. Only glGetProgramBinary
+ * runs on the GL thread; the file is written by a worker job.
+ */
+
+#define PROGCACHE_DIR    "shader-cache"
+#define PROGCACHE_MAGIC  0x4e494250u    // "PBIN"
+#define PROGCACHE_WRITES 8              // writes in flight, more are skipped
+
+struct progcache_header
+{
+    unsigned int magic;
+    unsigned int format;
+    unsigned long long key;
+    unsigned int length;
+};
+
+/* A binary copied out of the driver, waiting for a worker to write it */
+struct progcache_write
+{
+    struct job job;
+    struct progcache_header header;
+    void *binary;           // NULL when the slot is free
+};
+
+struct progcache
+{
+    bool enabled;
+    uint64_t driver_hash;
+    struct progcache_write writes[PROGCACHE_WRITES];
+
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int rejects;
+    unsigned int skipped;   // every write slot was busy
+    SDL_atomic_t stores;    // bumped by the workers
+};
+
+static struct progcache g__progcache;
+
+static void
+progcache_init (bool enabled)
+{
+    struct progcache *c = &g__progcache;
+    char *strings[3];
+    int formats = 0;
+
+    memset (c, 0, sizeof (*c));
+
+    if (!enabled)
+    {
+        return;
+    }
+
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+    {
+        LOG_ERROR ("Program binaries not supported, program cache disabled");
+        return;
+    }
+
+    GLCALL (glGetIntegerv (GL_NUM_PROGRAM_BINARY_FORMATS, &formats));
+    if (formats == 0)
+    {
+        LOG_ERROR ("Driver has no program binary formats, program cache disabled");
+        return;
+    }
+
+    strings[0] = (char *) glGetString (GL_VENDOR);
+    strings[1] = (char *) glGetString (GL_RENDERER);
+    strings[2] = (char *) glGetString (GL_VERSION);
+
+    c->driver_hash = HASH_FNV64_BASIS;
+    for (int i = 0; i < 3; i++)
+    {
+        c->driver_hash = hash_fnv1a (strings[i], strlen (strings[i]) + 1, c->driver_hash);
+    }
+
+    progcache_mkdir (PROGCACHE_DIR);
+    c->enabled = true;
+}
+
+static uint64_t
+progcache_key (const char *vertex_source, size_t vertex_len, const char *fragment_source, size_t fragment_len)
+{
+    uint64_t key = g__progcache.driver_hash;
+
+    /* lengths go in too, so moving bytes between the two stages changes the key */
+    key = hash_fnv1a (&vertex_len, sizeof (vertex_len), key);
+    key = hash_fnv1a (vertex_source, vertex_len, key);
+    key = hash_fnv1a (&fragment_len, sizeof (fragment_len), key);
+    key = hash_fnv1a (fragment_source, fragment_len, key);
+
+    return key;
+}
+
+static void
+_progcache_path (char *path, size_t len, uint64_t key)
+{
+    snprintf (path, len, PROGCACHE_DIR "/%016llx.bin", (unsigned long long) key);
+}
+
+/* Returns a linked program, or 0 on a miss or if the driver rejects the binary */
+static unsigned int
+progcache_load (uint64_t key)
+{
+    struct progcache *c = &g__progcache;
+    const struct progcache_header *header;
+    struct file_view view;
+    unsigned int program_id = 0;
+    char path[64];
+    int result = GL_FALSE;
+
+    if (!c->enabled)
+    {
+        return 0;
+    }
+
+    _progcache_path (path, sizeof (path), key);
+
+    if (!file_view_open (path, &view))
+    {
+        c->misses++;
+        return 0;
+    }
+
+    /* the binary goes to the driver straight from the mapping */
+    header = view.data;
+    if (view.len < sizeof (*header) ||
+        header->magic != PROGCACHE_MAGIC || header->key != key)
+    {
+        file_view_close (&view);
+        c->rejects++;
+        return 0;
+    }
+
+    if (view.len - sizeof (*header) >= header->length)
+    {
+        GLCALL (program_id = glCreateProgram ());
+        GLCHECK ("progcache_load");
+
+        /*
+         * A rejected binary is not an error, just a miss (GL_INVALID_ENUM
+         * for a format the driver dropped). Everything pending was reported
+         * above, so the one error read back here is this call's own, and
+         * the link status says whether it took.
+         */
+        glProgramBinary (program_id, header->format, header + 1, header->length);
+        glGetError ();
+        glGetProgramiv (program_id, GL_LINK_STATUS, &result);
+
+        if (result == GL_FALSE)
+        {
+            glDeleteProgram (program_id);
+            program_id = 0;
+        }
+    }
+
+    file_view_close (&view);
+
+    if (program_id)
+    {
+        c->hits++;
+    }
+    else
+    {
+        c->rejects++;
+    }
+
+    return program_id;
+}
+
+/* Call before glLinkProgram so the driver keeps the binary around */
+static void
+progcache_prepare (unsigned int program_id)
+{
+    if (g__progcache.enabled)
+    {
+        GLCALL (glProgramParameteri (program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+    }
+}
+
+static void
+_progcache_write_job (struct job *job)
+{
+    struct progcache_write *w = job->data;
+    char path[64];
+    FILE *fp;
+
+    _progcache_path (path, sizeof (path), w->header.key);
+
+    fp = fopen (path, "wb");
+    if (fp)
+    {
+        fwrite (&w->header, sizeof (w->header), 1, fp);
+        fwrite (w->binary, 1, w->header.length, fp);
+        fclose (fp);
+        SDL_AtomicAdd (&g__progcache.stores, 1);
+    }
+    else
+    {
+        LOG_ERROR ("Failed to write program binary '%s'", path);
+    }
+}
+
+/* A write slot whose last job is done, NULL if they are all busy */
+static struct progcache_write *
+_progcache_write_slot (void)
+{
+    struct progcache *c = &g__progcache;
+
+    for (int i = 0; i < PROGCACHE_WRITES; i++)
+    {
+        struct progcache_write *w = &c->writes[i];
+
+        if (w->binary && job_done (&w->job))
+        {
+            free (w->binary);
+            w->binary = NULL;
+        }
+
+        if (!w->binary)
+        {
+            return w;
+        }
+    }
+
+    return NULL;
+}
+
+/* Copies the binary out on the calling (GL) thread and leaves the file to a worker */
+static void
+progcache_store (uint64_t key, unsigned int program_id)
+{
+    struct progcache *c = &g__progcache;
+    struct progcache_write *w;
+    int length = 0;
+
+    if (!c->enabled)
+    {
+        return;
+    }
+
+    w = _progcache_write_slot ();
+    if (!w)
+    {
+        c->skipped++;
+        return;
+    }
+
+    GLCALL (glGetProgramiv (program_id, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (length <= 0)
+    {
+        return;
+    }
+
+    w->binary = malloc (length);
+    ASSERT (w->binary != NULL);
+
+    w->header = (struct progcache_header) { PROGCACHE_MAGIC, 0, key, 0 };
+    GLCALL (glGetProgramBinary (program_id, length, &length, &w->header.format, w->binary));
+    w->header.length = length;
+
+    w->job.run = _progcache_write_job;
+    w->job.data = w;
+    workers_submit (&w->job);
+}
+
+/* Waits for the writes still in flight; call before the workers stop */
+static void
+progcache_shutdown (void)
+{
+    struct progcache *c = &g__progcache;
+
+    for (int i = 0; i < PROGCACHE_WRITES; i++)
+    {
+        if (c->writes[i].binary)
+        {
+            job_wait (&c->writes[i].job);
+            free (c->writes[i].binary);
+            c->writes[i].binary = NULL;
+        }
+    }
+}
+
+static void
+progcache_report (void)
+{
+    struct progcache *c = &g__progcache;
+
+    printf ("Program cache: %s hits=%u misses=%u rejected=%u stored=%d skipped=%u\n",
+            c->enabled ? "on" : "off", c->hits, c->misses, c->rejects, SDL_AtomicGet (&c->stores), c->skipped);
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef _PROGRAM_
+#define _PROGRAM_
+
+#include "hash.h"
+
+/**
+ * Linked shader programs and their uniforms.
+ *
+ * When a program is linked its active uniforms are enumerated once and
+ * stored in a small open-addressed table keyed by the hashed name. The
+ * uniforms the render functions use are resolved up front into
+ * `locations`, so a frame only ever indexes an array.
+ */
+
+#define PROGRAM_MAX_UNIFORMS 16     // power of two
+#define UNIFORM_NAME_LEN     32
+
+enum uniform
+{
+    UNIFORM_COLOUR = 0,
+    UNIFORM_XFRM,
+    UNIFORM_TEXTURE0,
+    UNIFORM_TEXTURE1,
+    UNIFORM_MODEL,
+    UNIFORM_MAX
+};
+
+static char *g__uniform_names[UNIFORM_MAX] = {
+    [UNIFORM_COLOUR] = "u_colour",
+    [UNIFORM_XFRM] = "u_xfrm",
+    [UNIFORM_TEXTURE0] = "u_texture0",
+    [UNIFORM_TEXTURE1] = "u_texture1",
+    [UNIFORM_MODEL] = "u_model",
+};
+
+struct uniform_info
+{
+    uint32_t hash;
+    int location;
+    unsigned int type;
+    int size;
+    char name[UNIFORM_NAME_LEN];    // empty if the slot is free
+};
+
+enum program_status
+{
+    PROGRAM_PENDING = 0,    // compile/link submitted, not known to be done
+    PROGRAM_READY,
+    PROGRAM_FAILED
+};
+
+struct program
+{
+    unsigned int id;
+    enum program_status status;
+    char vertex_file[32];
+    char fragment_file[32];
+    unsigned int defines;   // enum shader_define mask the sources were built with
+    uint64_t variant_key;   // (files, defines), see program_variant_key()
+    uint64_t cache_key;     // program binary cache key
+    Uint64 submitted;
+
+    /* hot reload: the replacement being built, swapped in once it links */
+    struct program *reload;
+    Uint64 stale;           // a source changed then and no rebuild has started yet, 0 if not
+    Uint64 changed;         // when the source change was seen
+    double reload_ms;       // render thread time spent on it so far
+
+    int uniform_count;
+    struct uniform_info uniforms[PROGRAM_MAX_UNIFORMS];
+    int locations[UNIFORM_MAX];     // -1 if the program doesn't use it
+};
+
+/* Identifies one permutation of a vertex/fragment pair */
+static uint64_t
+program_variant_key (const char *vertex_file, const char *fragment_file, unsigned int defines)
+{
+    uint64_t key = HASH_FNV64_BASIS;
+
+    key = hash_fnv1a (vertex_file, strlen (vertex_file) + 1, key);
+    key = hash_fnv1a (fragment_file, strlen (fragment_file) + 1, key);
+
+    return hash_fnv1a (&defines, sizeof (defines), key);
+}
+
+/* Returns the location of any active uniform, -1 if there is none */
+static int
+program_find_uniform (struct program *p, const char *name)
+{
+    uint32_t hash = hash_string (name);
+
+    for (int i = 0; i < PROGRAM_MAX_UNIFORMS; i++)
+    {
+        struct uniform_info *u = &p->uniforms[(hash + i) & (PROGRAM_MAX_UNIFORMS - 1)];
+
+        if (u->name[0] == '\0')
+        {
+            break;
+        }
+        if (u->hash == hash && strcmp (u->name, name) == 0)
+        {
+            return u->location;
+        }
+    }
+
+    return -1;
+}
+
+static void
+_program_insert_uniform (struct program *p, struct uniform_info *info)
+{
+    for (int i = 0; i < PROGRAM_MAX_UNIFORMS; i++)
+    {
+        struct uniform_info *u = &p->uniforms[(info->hash + i) & (PROGRAM_MAX_UNIFORMS - 1)];
+
+        if (u->name[0] == '\0')
+        {
+            *u = *info;
+            p->uniform_count++;
+            return;
+        }
+    }
+
+    LOG_ERROR ("Program %u: too many uniforms, dropping '%s'", p->id, info->name);
+}
+
+/* Call once after a successful link */
+static void
+program_reflect (struct program *p)
+{
+    unsigned int id = p->id;
+    int count = 0;
+
+    p->uniform_count = 0;
+    memset (p->uniforms, 0, sizeof (p->uniforms));
+
+    GLCALL (glGetProgramiv (id, GL_ACTIVE_UNIFORMS, &count));
+
+    for (int i = 0; i < count; i++)
+    {
+        struct uniform_info info = {0};
+        char *bracket;
+        int len = 0;
+
+        GLCALL (glGetActiveUniform (id, i, UNIFORM_NAME_LEN, &len, &info.size, &info.type, info.name));
+
+        /* arrays are reported as "name[0]" */
+        if ((bracket = strchr (info.name, '[')) != NULL)
+        {
+            *bracket = '\0';
+        }
+
+        /* members of uniform blocks have no location */
+        GLCALL (info.location = glGetUniformLocation (id, info.name));
+        if (info.location < 0)
+        {
+            continue;
+        }
+
+        info.hash = hash_string (info.name);
+        _program_insert_uniform (p, &info);
+    }
+
+    for (int i = 0; i < UNIFORM_MAX; i++)
+    {
+        p->locations[i] = program_find_uniform (p, g__uniform_names[i]);
+    }
+}
+
+#endif
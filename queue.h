@@ -0,0 +1,97 @@
+#ifndef _QUEUE_
+#define _QUEUE_
+
+/**
+ * Single-producer/single-consumer ring buffer.
+ *
+ * Lock-free: the producer only ever writes `head` and the consumer only
+ * ever writes `tail`, so each side just needs to see the other's index.
+ * SDL_AtomicSet is not a full barrier everywhere (on GCC it only
+ * acquires), so each side puts a release barrier between touching a slot
+ * and publishing its index, and an acquire barrier between reading the
+ * other's index and touching the slot. Capacity must be a power of two.
+ */
+
+#define QUEUE_CACHE_LINE 64
+
+struct spsc_queue
+{
+    unsigned char *items;
+    int item_size;
+    int mask;
+
+    SDL_atomic_t head;  // next slot to write (producer)
+    char _pad0[QUEUE_CACHE_LINE - sizeof (SDL_atomic_t)];
+    SDL_atomic_t tail;  // next slot to read (consumer)
+    char _pad1[QUEUE_CACHE_LINE - sizeof (SDL_atomic_t)];
+};
+
+static void
+spsc_init (struct spsc_queue *q, int item_size, int capacity)
+{
+    ASSERT (capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+    memset (q, 0, sizeof (*q));
+    q->items = malloc ((size_t) item_size * capacity);
+    q->item_size = item_size;
+    q->mask = capacity - 1;
+
+    ASSERT (q->items != NULL);
+}
+
+static void
+spsc_free (struct spsc_queue *q)
+{
+    free (q->items);
+    q->items = NULL;
+}
+
+static int
+spsc_count (struct spsc_queue *q)
+{
+    return (int) ((unsigned int) SDL_AtomicGet (&q->head) - (unsigned int) SDL_AtomicGet (&q->tail));
+}
+
+/* Producer side. Returns false if the queue is full. */
+static bool
+spsc_push (struct spsc_queue *q, const void *item)
+{
+    int head = SDL_AtomicGet (&q->head);
+    int tail = SDL_AtomicGet (&q->tail);
+
+    if ((unsigned int) head - (unsigned int) tail > (unsigned int) q->mask)
+    {
+        return false;
+    }
+
+    /* the consumer is done reading the slot before we overwrite it */
+    SDL_MemoryBarrierAcquire ();
+    memcpy (q->items + (size_t) (head & q->mask) * q->item_size, item, q->item_size);
+    SDL_MemoryBarrierRelease ();
+    SDL_AtomicSet (&q->head, head + 1);
+
+    return true;
+}
+
+/* Consumer side. Returns false if the queue is empty. */
+static bool
+spsc_pop (struct spsc_queue *q, void *item)
+{
+    int tail = SDL_AtomicGet (&q->tail);
+    int head = SDL_AtomicGet (&q->head);
+
+    if (head == tail)
+    {
+        return false;
+    }
+
+    /* the producer's copy into the slot is visible before we read it */
+    SDL_MemoryBarrierAcquire ();
+    memcpy (item, q->items + (size_t) (tail & q->mask) * q->item_size, q->item_size);
+    SDL_MemoryBarrierRelease ();
+    SDL_AtomicSet (&q->tail, tail + 1);
+
+    return true;
+}
+
+#endif
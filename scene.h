@@ -0,0 +1,288 @@
+#ifndef _SCENE_
+#define _SCENE_
+
+/**
+ * Stress-test scene generator.
+ *
+ * Builds N spinning cubes from a seed so the same scene can be recreated
+ * exactly between runs. Objects are grouped by texture so each texture
+ * is one contiguous range (one instanced draw each). Every frame is split
+ * into three timed stages: transform update, frustum culling and
+ * submission (timed by the caller).
+ */
+
+#define SCENE_TEXTURES       2
+#define SCENE_OBJECT_RADIUS  0.87f  // bounding sphere of a unit cube
+#define SCENE_SPACING        3.0f   // average distance between neighbours
+
+enum scene_distribution
+{
+    SCENE_UNIFORM = 0,  // uniformly inside a box
+    SCENE_SHELL,        // on the surface of a sphere
+    SCENE_GRID,         // regular lattice
+    SCENE_DISTRIBUTION_MAX
+};
+
+struct scene_object
+{
+    vec3_t position;
+    vec3_t axis;
+    float speed;    // radians per second
+    float phase;
+};
+
+struct scene_stats
+{
+    unsigned int frames;
+    double update_ms;
+    double cull_ms;
+    double submit_ms;
+    unsigned long visible;
+};
+
+struct scene
+{
+    int count;
+    unsigned int seed;
+    enum scene_distribution distribution;
+    float max_speed;
+    float texture1_ratio;   // fraction of objects using the second texture
+    float extent;           // objects lie within [-extent, extent]^3
+
+    struct scene_object *objects;
+    mat4_t *models;
+    mat4_t *visible;        // compacted per texture range
+    int texture_first[SCENE_TEXTURES];
+    int texture_count[SCENE_TEXTURES];
+    int visible_count[SCENE_TEXTURES];
+
+    struct scene_stats stats;
+};
+
+static char *
+scene_distribution_name (enum scene_distribution d)
+{
+    switch (d)
+    {
+        case SCENE_UNIFORM: return "uniform";
+        case SCENE_SHELL: return "shell";
+        case SCENE_GRID: return "grid";
+        default: return "???";
+    }
+}
+
+/* SCENE_DISTRIBUTION_MAX if `name` isn't one */
+static enum scene_distribution
+scene_distribution_parse (char *name)
+{
+    for (int i = 0; i < SCENE_DISTRIBUTION_MAX; i++)
+    {
+        if (strcmp (name, scene_distribution_name (i)) == 0)
+        {
+            return i;
+        }
+    }
+
+    return SCENE_DISTRIBUTION_MAX;
+}
+
+/* xorshift32, never seed with 0 */
+static unsigned int
+_scene_rand (unsigned int *state)
+{
+    unsigned int x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+static float
+_scene_randf (unsigned int *state, float lo, float hi)
+{
+    return lo + (hi - lo) * ((_scene_rand (state) >> 8) / 16777216.0f);
+}
+
+static vec3_t
+_scene_rand_unit (unsigned int *state)
+{
+    vec3_t v;
+    float len;
+
+    do
+    {
+        v = vec3 (_scene_randf (state, -1, 1), _scene_randf (state, -1, 1), _scene_randf (state, -1, 1));
+        len = v3_length (v);
+    } while (len < 0.01f || len > 1.0f);
+
+    return v3_divs (v, len);
+}
+
+static void
+scene_free (struct scene *sc)
+{
+    free (sc->objects);
+    free (sc->models);
+    free (sc->visible);
+    sc->objects = NULL;
+    sc->models = NULL;
+    sc->visible = NULL;
+    sc->count = 0;
+}
+
+static void
+scene_generate (struct scene *sc, int count, unsigned int seed, enum scene_distribution distribution)
+{
+    unsigned int rng = seed ? seed : 1;
+    int side = (int) ceil (cbrt ((double) count));
+    int first = 0;
+    int last = count;
+
+    scene_free (sc);
+
+    sc->count = count;
+    sc->seed = seed;
+    sc->distribution = distribution;
+    sc->extent = 0.5f * SCENE_SPACING * side;
+
+    sc->objects = malloc (count * sizeof (struct scene_object));
+    sc->models = malloc (count * sizeof (mat4_t));
+    sc->visible = malloc (count * sizeof (mat4_t));
+    ASSERT (sc->objects && sc->models && sc->visible);
+
+    for (int i = 0; i < count; i++)
+    {
+        struct scene_object o;
+        float e = sc->extent;
+
+        switch (distribution)
+        {
+            case SCENE_SHELL:
+                o.position = v3_muls (_scene_rand_unit (&rng), e * _scene_randf (&rng, 0.9f, 1.0f));
+                break;
+            case SCENE_GRID:
+                o.position = vec3 (-e + SCENE_SPACING * (i % side + 0.5f),
+                                   -e + SCENE_SPACING * ((i / side) % side + 0.5f),
+                                   -e + SCENE_SPACING * (i / (side * side) + 0.5f));
+                break;
+            default:
+                o.position = vec3 (_scene_randf (&rng, -e, e), _scene_randf (&rng, -e, e), _scene_randf (&rng, -e, e));
+                break;
+        }
+
+        o.axis = _scene_rand_unit (&rng);
+        o.speed = _scene_randf (&rng, 0.1f, 1.0f) * sc->max_speed;
+        o.phase = _scene_randf (&rng, 0.0f, 2.0f * (float) M_PI);
+
+        /* partition by texture: texture 0 grows from the front, texture 1 from the back */
+        if (_scene_randf (&rng, 0.0f, 1.0f) < sc->texture1_ratio)
+        {
+            sc->objects[--last] = o;
+        }
+        else
+        {
+            sc->objects[first++] = o;
+        }
+    }
+
+    sc->texture_first[0] = 0;
+    sc->texture_count[0] = first;
+    sc->texture_first[1] = first;
+    sc->texture_count[1] = count - first;
+
+    memset (&sc->stats, 0, sizeof (sc->stats));
+
+    printf ("Generated scene: %d objects, seed=%u, %s, extent=%.1f (textures %d/%d)\n",
+            count, seed, scene_distribution_name (distribution), sc->extent,
+            sc->texture_count[0], sc->texture_count[1]);
+}
+
+static void
+scene_update (struct scene *sc, float secs)
+{
+    for (int i = 0; i < sc->count; i++)
+    {
+        struct scene_object *o = &sc->objects[i];
+
+        sc->models[i] = m4_mul (m4_translation (o->position), m4_rotation (o->phase + secs * o->speed, o->axis));
+    }
+}
+
+/* Frustum planes (a, b, c, d) from a view-projection matrix, pointing inwards */
+static void
+_scene_frustum (mat4_t *vp, float planes[6][4])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            planes[i * 2 + 0][j] = vp->m[j][3] + vp->m[j][i];
+            planes[i * 2 + 1][j] = vp->m[j][3] - vp->m[j][i];
+        }
+    }
+
+    for (int i = 0; i < 6; i++)
+    {
+        float len = sqrtf (planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+
+        for (int j = 0; j < 4; j++)
+        {
+            planes[i][j] /= len;
+        }
+    }
+}
+
+/* Copies the models of objects inside the frustum into `visible` */
+static void
+scene_cull (struct scene *sc, mat4_t *view_projection)
+{
+    float planes[6][4];
+
+    _scene_frustum (view_projection, planes);
+
+    for (int t = 0; t < SCENE_TEXTURES; t++)
+    {
+        int first = sc->texture_first[t];
+        int end = first + sc->texture_count[t];
+        int n = first;
+
+        for (int i = first; i < end; i++)
+        {
+            vec3_t c = sc->objects[i].position;
+            bool inside = true;
+
+            for (int p = 0; p < 6 && inside; p++)
+            {
+                float d = planes[p][0] * c.x + planes[p][1] * c.y + planes[p][2] * c.z + planes[p][3];
+                inside = d > -SCENE_OBJECT_RADIUS;
+            }
+
+            if (inside)
+            {
+                sc->visible[n++] = sc->models[i];
+            }
+        }
+
+        sc->visible_count[t] = n - first;
+    }
+}
+
+static void
+scene_report (struct scene *sc)
+{
+    struct scene_stats *s = &sc->stats;
+
+    if (s->frames == 0)
+    {
+        return;
+    }
+
+    printf ("[scene %d] update=%.3f cull=%.3f submit=%.3f ms/frame, visible=%lu/%d\n",
+            sc->count, s->update_ms / s->frames, s->cull_ms / s->frames, s->submit_ms / s->frames,
+            s->visible / s->frames, sc->count);
+}
+
+#endif
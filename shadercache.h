@@ -0,0 +1,111 @@
+#ifndef _SHADERCACHE_
+#define _SHADERCACHE_
+
+#include "hash.h"
+
+/**
+ * Compiled shader objects keyed by (stage, source hash).
+ *
+ * Between shader_cache_begin() and shader_cache_end() every compiled
+ * stage is kept alive, so a source shared by several programs (tex.vs)
+ * is compiled once and attached to all of them. Outside that window the
+ * cache is inactive and callers own the shader objects they compile.
+ */
+
+#define SHADER_CACHE_MAX 32
+
+struct shader_cache_entry
+{
+    unsigned int type;
+    uint64_t hash;
+    unsigned int id;
+    unsigned int uses;
+};
+
+struct shader_cache
+{
+    bool active;
+    int count;
+    struct shader_cache_entry entries[SHADER_CACHE_MAX];
+
+    unsigned int compiles;
+    unsigned int reuses;
+};
+
+static struct shader_cache g__shader_cache;
+
+static void
+shader_cache_begin (void)
+{
+    memset (&g__shader_cache, 0, sizeof (g__shader_cache));
+    g__shader_cache.active = true;
+}
+
+static uint64_t
+shader_cache_hash (const char *source, size_t len)
+{
+    return hash_fnv1a (source, len, HASH_FNV64_BASIS);
+}
+
+/* Returns 0 on a miss */
+static unsigned int
+shader_cache_find (unsigned int type, uint64_t hash)
+{
+    struct shader_cache *c = &g__shader_cache;
+
+    if (!c->active)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < c->count; i++)
+    {
+        struct shader_cache_entry *e = &c->entries[i];
+
+        if (e->type == type && e->hash == hash)
+        {
+            e->uses++;
+            c->reuses++;
+            return e->id;
+        }
+    }
+
+    return 0;
+}
+
+/* Returns false if the cache isn't holding on to the shader (caller deletes it) */
+static bool
+shader_cache_insert (unsigned int type, uint64_t hash, unsigned int id)
+{
+    struct shader_cache *c = &g__shader_cache;
+
+    c->compiles++;
+
+    if (!c->active || c->count == SHADER_CACHE_MAX)
+    {
+        return false;
+    }
+
+    c->entries[c->count++] = (struct shader_cache_entry) { type, hash, id, 1 };
+
+    return true;
+}
+
+/* Releases every cached shader object, programs keep what they linked */
+static void
+shader_cache_end (void)
+{
+    struct shader_cache *c = &g__shader_cache;
+
+    for (int i = 0; i < c->count; i++)
+    {
+        GLCALL (glDeleteShader (c->entries[i].id));
+    }
+
+    printf ("Shader cache: %u compiled, %u reused\n", c->compiles, c->reuses);
+
+    c->count = 0;
+    c->active = false;
+}
+
+#endif
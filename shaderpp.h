@@ -0,0 +1,324 @@
+#ifndef _SHADERPP_
+#define _SHADERPP_
+
+#include <stdarg.h>
+
+/**
+ * Shader source preprocessor.
+ *
+ * Expands `#include "file"` (GLSL has no includes of its own) and turns
+ * a bit mask of permutation flags into `#define`s placed right after the
+ * `#version` line, so one source can be compiled into specialised
+ * variants and the GLSL preprocessor strips the branches and samplers a
+ * variant doesn't use. Only the defines a source actually mentions are
+ * emitted, so a stage that doesn't care about a flag comes out
+ * byte-identical and is shared through the shader object cache.
+ *
+ * `#line` directives keep compile errors pointing at the original line;
+ * the source-string number is 0 for the top-level file and 1 + the
+ * index into g__shader_includes for included ones.
+ *
+ * Hot reload preprocesses on a worker while the render thread may build
+ * a new variant, so the include registry is guarded by a spin lock. A
+ * batch of shaderpp_load() calls can share a shaderpp_files so every
+ * file the batch touches is only read once.
+ */
+
+#define SHADERPP_MAX_DEPTH    8
+#define SHADERPP_MAX_INCLUDES 16
+#define SHADERPP_MAX_FILES    16
+
+enum shader_define
+{
+    SHADER_VERTEX_COLOUR = 1 << 0,  // multiply by the interpolated vertex colour
+    SHADER_TEX_MIX       = 1 << 1,  // blend in a second texture
+    SHADER_INSTANCED     = 1 << 2,  // per-instance model matrix instead of u_model
+    SHADER_DEFINE_COUNT  = 3
+};
+
+static char *g__shader_define_names[SHADER_DEFINE_COUNT] = {
+    "VERTEX_COLOUR",
+    "TEX_MIX",
+    "INSTANCED",
+};
+
+/* Every file pulled in through #include, hot reload watches these too */
+static char g__shader_includes[SHADERPP_MAX_INCLUDES][32];
+static int g__shader_include_count;
+static SDL_SpinLock g__shader_include_lock;
+
+/* Files kept open across a batch of shaderpp_load() calls */
+struct shaderpp_files
+{
+    int count;
+    char names[SHADERPP_MAX_FILES][32];
+    struct asset assets[SHADERPP_MAX_FILES];
+};
+
+struct _spp_buffer
+{
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+static void
+_spp_append (struct _spp_buffer *b, const char *str, size_t len)
+{
+    if (b->len + len + 1 > b->cap)
+    {
+        b->cap = (b->len + len + 1) * 2;
+        b->data = realloc (b->data, b->cap);
+        ASSERT (b->data != NULL);
+    }
+
+    memcpy (b->data + b->len, str, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+static void
+_spp_appendf (struct _spp_buffer *b, const char *fmt, ...)
+{
+    char line[128];
+    va_list args;
+    int len;
+
+    va_start (args, fmt);
+    len = vsnprintf (line, sizeof (line), fmt, args);
+    va_end (args);
+
+    _spp_append (b, line, len);
+}
+
+static int
+_spp_include_index_find (const char *file)
+{
+    for (int i = 0; i < g__shader_include_count; i++)
+    {
+        if (strcmp (g__shader_includes[i], file) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int
+_spp_include_index (const char *file)
+{
+    int index;
+
+    SDL_AtomicLock (&g__shader_include_lock);
+
+    index = _spp_include_index_find (file);
+    if (index < 0)
+    {
+        ASSERT (g__shader_include_count < SHADERPP_MAX_INCLUDES);
+        snprintf (g__shader_includes[g__shader_include_count], sizeof (g__shader_includes[0]), "%s", file);
+        index = g__shader_include_count++;
+    }
+
+    SDL_AtomicUnlock (&g__shader_include_lock);
+
+    return index;
+}
+
+/* Opens `file`, or finds it already open in `files`; NULL if it can't be found */
+static const struct asset *
+_spp_open (struct shaderpp_files *files, const char *file, struct asset *own)
+{
+    if (!files)
+    {
+        return asset_open (file, own) ? own : NULL;
+    }
+
+    for (int i = 0; i < files->count; i++)
+    {
+        if (strcmp (files->names[i], file) == 0)
+        {
+            return &files->assets[i];
+        }
+    }
+
+    if (files->count == SHADERPP_MAX_FILES)
+    {
+        return asset_open (file, own) ? own : NULL;
+    }
+
+    if (!asset_open (file, &files->assets[files->count]))
+    {
+        return NULL;
+    }
+    snprintf (files->names[files->count], sizeof (files->names[0]), "%s", file);
+
+    return &files->assets[files->count++];
+}
+
+/* Only closes what _spp_open() didn't leave in `files` */
+static void
+_spp_close (const struct asset *asset, struct asset *own)
+{
+    if (asset == own)
+    {
+        asset_close (own);
+    }
+}
+
+static bool
+_spp_expand (struct _spp_buffer *b, const char *file, int source, int depth, struct shaderpp_files *files)
+{
+    struct asset own;
+    const struct asset *asset;
+    const char *line;
+    const char *file_end;
+    int line_no = 1;
+
+    if (depth > SHADERPP_MAX_DEPTH)
+    {
+        LOG_ERROR ("Shader includes nested too deep at '%s'", file);
+        return false;
+    }
+
+    asset = _spp_open (files, file, &own);
+    if (!asset)
+    {
+        return false;
+    }
+
+    /* the source is a mapped file, nothing is terminated */
+    file_end = asset->data + asset->len;
+
+    for (line = asset->data; line < file_end; line_no++)
+    {
+        const char *eol = memchr (line, '\n', file_end - line);
+        const char *line_end = eol ? eol + 1 : file_end;
+        const char *p = line;
+
+        while (p < line_end && (*p == ' ' || *p == '\t')) p++;
+
+        if (line_end - p >= 8 && memcmp (p, "#include", 8) == 0)
+        {
+            char name[32];
+            int index;
+            const char *open = memchr (p, '"', line_end - p);
+            const char *close = open ? memchr (open + 1, '"', line_end - open - 1) : NULL;
+
+            if (!close || close - open - 1 >= (int) sizeof (name))
+            {
+                LOG_ERROR ("%s:%d: malformed #include", file, line_no);
+                _spp_close (asset, &own);
+                return false;
+            }
+
+            snprintf (name, sizeof (name), "%.*s", (int) (close - open - 1), open + 1);
+
+            index = 1 + _spp_include_index (name);
+            _spp_appendf (b, "#line 1 %d\n", index);
+            if (!_spp_expand (b, name, index, depth + 1, files))
+            {
+                _spp_close (asset, &own);
+                return false;
+            }
+            _spp_appendf (b, "\n#line %d %d\n", line_no + 1, source);
+        }
+        else
+        {
+            _spp_append (b, line, line_end - line);
+        }
+
+        line = line_end;
+    }
+
+    _spp_close (asset, &own);
+
+    return true;
+}
+
+/* True once some shader has pulled the file in through #include */
+static bool
+shaderpp_is_include (const char *file)
+{
+    int index;
+
+    SDL_AtomicLock (&g__shader_include_lock);
+    index = _spp_include_index_find (file);
+    SDL_AtomicUnlock (&g__shader_include_lock);
+
+    return index >= 0;
+}
+
+static void
+shaderpp_files_close (struct shaderpp_files *files)
+{
+    for (int i = 0; i < files->count; i++)
+    {
+        asset_close (&files->assets[i]);
+    }
+
+    files->count = 0;
+}
+
+/**
+ * Returns the expanded source and its length, or NULL. Must be freed
+ * with free(). `files` may be NULL, then every file is opened and
+ * closed again here.
+ */
+static char *
+shaderpp_load (const char *file, unsigned int defines, struct shaderpp_files *files, size_t *len)
+{
+    struct _spp_buffer body = {0};
+    struct _spp_buffer out = {0};
+    char *version;
+    char *rest;
+    int version_line = 1;
+
+    if (!_spp_expand (&body, file, 0, 0, files))
+    {
+        free (body.data);
+        return NULL;
+    }
+
+    /* say, caught mid-save by hot reload: fail so the old program stays */
+    if (!body.data)
+    {
+        LOG_ERROR ("Shader '%s' is empty", file);
+        return NULL;
+    }
+
+    /* the defines have to come after #version, which must come first */
+    version = strstr (body.data, "#version");
+    rest = version ? strchr (version, '\n') : NULL;
+    if (!rest)
+    {
+        *len = body.len;
+        return body.data;
+    }
+    rest++;
+
+    for (char *c = body.data; c < version; c++)
+    {
+        if (*c == '\n') version_line++;
+    }
+
+    _spp_append (&out, body.data, rest - body.data);
+
+    for (int i = 0; i < SHADER_DEFINE_COUNT; i++)
+    {
+        if ((defines & (1u << i)) && strstr (rest, g__shader_define_names[i]))
+        {
+            _spp_appendf (&out, "#define %s 1\n", g__shader_define_names[i]);
+        }
+    }
+
+    _spp_appendf (&out, "#line %d 0\n", version_line + 1);
+    _spp_append (&out, rest, strlen (rest));
+
+    free (body.data);
+    *len = out.len;
+
+    return out.data;
+}
+
+#endif
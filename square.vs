@@ -2,7 +2,9 @@
 
 layout (location = 0) in vec3 pos;
 
+#include "camera.glsl"
+
 void main()
 {
-    gl_Position = vec4 (pos.x, pos.y, pos.z, 1.0);
+    gl_Position = camera.view_projection * vec4 (pos.x, pos.y, pos.z, 1.0);
 }
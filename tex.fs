@@ -1,13 +1,26 @@
 #version 330 core
 
+#ifdef VERTEX_COLOUR
 in vec3 vert_colour;
+#endif
 in vec2 vert_tex_coords;
 
 out vec4 frag_colour;
 
-uniform sampler2D u_texture;
+uniform sampler2D u_texture0;
+#ifdef TEX_MIX
+uniform sampler2D u_texture1;
+#endif
 
 void main()
 {
-    frag_colour = texture(u_texture, vert_tex_coords);
+#ifdef TEX_MIX
+    frag_colour = mix(texture(u_texture0, vert_tex_coords),
+                      texture(u_texture1, vert_tex_coords), 0.2);
+#else
+    frag_colour = texture(u_texture0, vert_tex_coords);
+#endif
+#ifdef VERTEX_COLOUR
+    frag_colour *= vec4(vert_colour, 1.0);
+#endif
 }
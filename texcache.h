@@ -0,0 +1,188 @@
+#ifndef _TEXCACHE_
+#define _TEXCACHE_
+
+/**
+ * On-disk cache of decoded textures.
+ *
+ * Keyed by a hash of the encoded file plus the load parameters (flip,
+ * channel count, mip filter, block compression, usage flags), so an edited image or a different way of loading it is
+ * simply a miss. An entry is a texcache_header followed by a
+ * pack_texture (packformat.h): in the format it is uploaded in, with the full mip chain, laid
+ * out so it can be mapped and uploaded level by level with no decoding.
+ * The header records what the decode cost, so a hit can report the time
+ * it saved.
+ */
+
+#define TEXCACHE_DIR     "texture-cache"
+#define TEXCACHE_MAGIC   0x58455454u    // "TTEX"
+#define TEXCACHE_VERSION 1
+
+/* Padded to PACK_ALIGN so the levels after it stay aligned in the file */
+struct texcache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t decode_us;     // decode, mips and compression on the miss that wrote it
+    uint32_t channels;      // of the source image, for reporting
+    uint8_t _pad[PACK_ALIGN - 28];
+};
+
+struct texcache
+{
+    bool enabled;
+
+    /* lookups and stores run on the worker pool */
+    SDL_atomic_t hits;
+    SDL_atomic_t misses;
+    SDL_atomic_t stores;
+    double saved_ms;        // recorded decode time minus the time the hits took, GL thread only
+};
+
+static struct texcache g__texcache;
+
+static void
+texcache_init (bool enabled)
+{
+    memset (&g__texcache, 0, sizeof (g__texcache));
+
+    if (enabled)
+    {
+        progcache_mkdir (TEXCACHE_DIR);
+        g__texcache.enabled = true;
+    }
+}
+
+static uint64_t
+texcache_key (const void *data, size_t len, bool flip, int channels, enum mips_filter filter, bool compress,
+              unsigned int flags)
+{
+    uint64_t key = HASH_FNV64_BASIS;
+    uint32_t params[5] = { flip, (uint32_t) channels, filter, compress, flags };
+
+    key = hash_fnv1a (params, sizeof (params), key);
+
+    return hash_fnv1a (data, len, key);
+}
+
+static void
+_texcache_path (char *path, size_t len, uint64_t key)
+{
+    snprintf (path, len, TEXCACHE_DIR "/%016llx.tex", (unsigned long long) key);
+}
+
+/**
+ * Maps the entry for `key`. Returns its header, the pack_texture follows
+ * it (texcache_texture), or NULL on a miss; the view must be closed once
+ * the levels are uploaded.
+ */
+static const struct texcache_header *
+texcache_load (uint64_t key, struct file_view *view)
+{
+    struct texcache *c = &g__texcache;
+    const struct texcache_header *header;
+    char path[64];
+
+    if (!c->enabled)
+    {
+        return NULL;
+    }
+
+    _texcache_path (path, sizeof (path), key);
+
+    if (!file_view_open (path, view))
+    {
+        SDL_AtomicAdd (&c->misses, 1);
+        return NULL;
+    }
+
+    header = view->data;
+    if (view->len < sizeof (*header) + sizeof (struct pack_texture) ||
+        header->magic != TEXCACHE_MAGIC || header->version != TEXCACHE_VERSION || header->key != key)
+    {
+        file_view_close (view);
+        SDL_AtomicAdd (&c->misses, 1);
+        return NULL;
+    }
+
+    SDL_AtomicAdd (&c->hits, 1);
+
+    return header;
+}
+
+static const struct pack_texture *
+texcache_texture (const struct texcache_header *header)
+{
+    return (const struct pack_texture *) (header + 1);
+}
+
+/* Counts what a hit saved, `load_ms` being what the hit cost instead */
+static void
+texcache_hit_time (const struct texcache_header *header, double load_ms)
+{
+    g__texcache.saved_ms += header->decode_us / 1000.0 - load_ms;
+}
+
+/* Writes a pack_texture_build() block; a failed write just leaves no entry */
+static void
+texcache_store (uint64_t key, const struct pack_texture *tex, uint64_t size, int channels, double decode_ms)
+{
+    struct texcache *c = &g__texcache;
+    struct texcache_header header = {0};
+    char path[64];
+    char tmp[72];
+    bool ok;
+    FILE *fp;
+
+    if (!c->enabled)
+    {
+        return;
+    }
+
+    _texcache_path (path, sizeof (path), key);
+    snprintf (tmp, sizeof (tmp), "%s.tmp", path);
+
+    fp = fopen (tmp, "wb");
+    if (!fp)
+    {
+        return;
+    }
+
+    header.magic = TEXCACHE_MAGIC;
+    header.version = TEXCACHE_VERSION;
+    header.key = key;
+    header.decode_us = (uint64_t) (decode_ms * 1000.0);
+    header.channels = channels;
+
+    ok = fwrite (&header, sizeof (header), 1, fp) == 1 && fwrite (tex, 1, size, fp) == size;
+    ok = fclose (fp) == 0 && ok;
+
+    /* rename so a half-written entry is never picked up */
+    remove (path);
+    if (ok && rename (tmp, path) == 0)
+    {
+        SDL_AtomicAdd (&c->stores, 1);
+    }
+    else
+    {
+        remove (tmp);
+    }
+}
+
+/* Only meaningful once the textures it covers have finished streaming */
+static void
+texcache_report (void)
+{
+    struct texcache *c = &g__texcache;
+
+    if (!c->enabled)
+    {
+        printf ("Texture cache: disabled\n");
+        return;
+    }
+
+    printf ("Texture cache: hits=%d misses=%d stores=%d, saved %.2f ms of decoding\n",
+            SDL_AtomicGet (&c->hits), SDL_AtomicGet (&c->misses), SDL_AtomicGet (&c->stores), c->saved_ms);
+}
+
+#endif
@@ -0,0 +1,631 @@
+#ifndef _TEXSTREAM_
+#define _TEXSTREAM_
+
+/**
+ * Asynchronous texture loading.
+ *
+ * texture_request() returns a GL texture name straight away, holding a
+ * 1x1 placeholder, and queues a job on the worker pool (workers.h) that
+ * gets the pixels ready: a pack entry is used as it is, otherwise the
+ * texture cache (texcache.h) is tried and on a miss the image is decoded
+ * with stb_image, its mip chain built (mips.h) and the cache filled. Mips
+ * never come from glGenerateMipmap, which some drivers run in software
+ * on the GL thread; different textures build theirs in parallel. Where
+ * the GL has S3TC, textures are block compressed (bc.h) on the worker
+ * too, BC1 if opaque and BC3 if not, and uploaded with
+ * glCompressedTexImage2D. Otherwise they are narrowed (pixfmt.h) to the
+ * channels their pixels use, R8 for grey, RG8 for grey + alpha, RGB8 (or
+ * RGB565 with TEXTURE_LOW_PRECISION) for opaque colour, and a swizzle
+ * mask hands shaders RGBA as before. The GL thread picks finished jobs
+ * up in texture_stream_update() and uploads them into the same name, so
+ * whoever holds the handle simply starts drawing the real texture.
+ *
+ * With the pixel buffer ring (pbo.h) the GL thread only maps a buffer;
+ * another job copies the pixels into it and the upload a frame later
+ * reads from the buffer, so neither the GL thread nor the driver copies
+ * them synchronously.
+ *
+ * Requests and uploads happen on the GL thread only; workers never touch
+ * GL or the table itself, they only fill in their own load and mark the
+ * job done.
+ */
+
+#define TEXTURE_MAX             16
+#define TEXTURE_UPLOADS_PER_FRAME 2
+
+/* How a texture is used, passed to texture_request() */
+#define TEXTURE_LOW_PRECISION   (1u << 0)   // opaque colour may drop to RGB565
+
+enum texture_status
+{
+    TEXTURE_EMPTY = 0,
+    TEXTURE_LOADING,    // job queued or running
+    TEXTURE_COPYING,    // decoded, a worker is filling t->pbo
+    TEXTURE_READY,
+    TEXTURE_FAILED      // stays on the placeholder
+};
+
+struct texture_load
+{
+    struct job job;
+    char name[32];
+    unsigned int flags;
+    unsigned int id;
+    enum texture_status status;
+    Uint64 requested;
+
+    struct asset asset;
+
+    /* filled in by the worker */
+    const struct pack_texture *levels;      // pack entry or texture cache mapping
+    size_t levels_len;
+    const struct texcache_header *cached;
+    struct file_view cache_view;
+    struct pack_texture *built;             // decoded here, levels points at it
+    int width;
+    int height;
+    int channels;
+    double decode_ms;
+    double mips_ms;
+    double convert_ms;      // block compressing or narrowing, or expanding BC for a GL without S3TC
+
+    struct pbo *pbo;
+    double map_ms;          // GL thread, mapping t->pbo
+    double copy_ms;
+
+    enum pack_format format;
+    uint64_t vram_bytes;
+    uint64_t rgba8_bytes;
+};
+
+struct texture_stream
+{
+    struct texture_load loads[TEXTURE_MAX];
+    int count;
+    int pending;
+    bool reported;
+    enum mips_filter filter;
+    bool compress;          // BC1/BC3, only if the GL has S3TC
+
+    uint64_t vram_bytes;
+    uint64_t rgba8_bytes;   // what the same textures would take as RGBA8
+
+    uint64_t bytes;
+    double upload_ms;       // on the GL thread
+    double copy_ms;         // into pixel buffers, on the workers
+    double slowest_ms;      // request to upload
+};
+
+static struct texture_stream g__textures;
+
+static bool
+_texture_levels_valid (const struct pack_texture *tex, size_t len)
+{
+    if (len < sizeof (*tex) || tex->format >= PACK_FORMAT_MAX || tex->levels == 0 || tex->levels > PACK_MAX_LEVELS)
+    {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < tex->levels; i++)
+    {
+        int lw = tex->width >> i ? tex->width >> i : 1;
+        int lh = tex->height >> i ? tex->height >> i : 1;
+
+        if (tex->level_offset[i] + tex->level_size[i] > len || tex->level_size[i] != pack_level_size (tex->format, lw, lh) ||
+            (i > 0 && tex->level_offset[i] < tex->level_offset[i - 1] + tex->level_size[i - 1]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Replaces t->levels with a copy in `format`; false if out of memory */
+static bool
+_texture_replace (struct texture_load *t, enum pack_format format)
+{
+    uint64_t size;
+    struct pack_texture *converted = pack_texture_convert (t->levels, format, &size);
+
+    free (t->built);
+    t->built = converted;
+    t->levels = converted;
+    t->levels_len = size;
+
+    return converted != NULL;
+}
+
+/* Narrowest uncompressed format holding what the top level's pixels actually use */
+static enum pack_format
+_texture_narrow_format (const struct texture_load *t)
+{
+    const struct pack_texture *tex = t->levels;
+    const unsigned char *top = (const unsigned char *) tex + tex->level_offset[0];
+
+    switch (pixfmt_channels (top, (size_t) tex->width * tex->height))
+    {
+        case 1: return PACK_R8;
+        case 2: return PACK_RG8;
+        case 3: return t->flags & TEXTURE_LOW_PRECISION ? PACK_RGB565 : PACK_RGB8;
+        default: return PACK_RGBA8;
+    }
+}
+
+/**
+ * Brings t->levels to the format the upload wants: BC1/BC3 when
+ * compressing (keeping whichever one it already is), otherwise the
+ * narrowest of R8, RG8, RGB8/RGB565 and RGBA8 that loses nothing the
+ * texture is used for. Pack entries are in whatever format the pack was
+ * built with, so a BC one is expanded first when not compressing.
+ */
+static void
+_texture_convert (struct texture_load *t)
+{
+    enum pack_format from = t->levels->format;
+    enum pack_format want;
+    Uint64 start = SDL_GetPerformanceCounter ();
+
+    if (g__textures.compress)
+    {
+        want = from != PACK_RGBA8 ? from : pack_texture_bc_format (t->levels);
+    }
+    else
+    {
+        if ((from == PACK_BC1 || from == PACK_BC3) && !_texture_replace (t, PACK_RGBA8))
+        {
+            return;
+        }
+        want = t->levels->format == PACK_RGBA8 ? _texture_narrow_format (t) : (enum pack_format) t->levels->format;
+    }
+
+    if (want != (enum pack_format) t->levels->format && !_texture_replace (t, want))
+    {
+        return;
+    }
+
+    if (t->levels->format != from)
+    {
+        t->convert_ms = (SDL_GetPerformanceCounter () - start) * 1000.0 / SDL_GetPerformanceFrequency ();
+    }
+}
+
+static void
+_texture_job (struct job *job)
+{
+    struct texture_load *t = job->data;
+    struct asset *a = &t->asset;
+    unsigned char *pixels;
+    Uint64 start;
+    Uint64 decoded;
+    uint64_t size;
+    uint64_t key;
+
+    if (a->pack && a->pack->type == PACK_TEXTURE)
+    {
+        t->levels = (const struct pack_texture *) a->data;
+        t->levels_len = a->len;
+
+        /* never trust offsets into a mapping */
+        if (!_texture_levels_valid (t->levels, t->levels_len))
+        {
+            t->levels = NULL;
+            return;
+        }
+
+        _texture_convert (t);
+        return;
+    }
+
+    /* same flip and channel count as stbi is asked for below */
+    key = texcache_key (a->data, a->len, true, 4, g__textures.filter, g__textures.compress, t->flags);
+
+    t->cached = texcache_load (key, &t->cache_view);
+    if (t->cached)
+    {
+        t->levels = texcache_texture (t->cached);
+        t->levels_len = t->cache_view.len - sizeof (*t->cached);
+        t->channels = t->cached->channels;
+        if (!_texture_levels_valid (t->levels, t->levels_len))
+        {
+            t->levels = NULL;
+        }
+        return;
+    }
+
+    start = SDL_GetPerformanceCounter ();
+    pixels = stbi_load_from_memory ((const unsigned char *) a->data, (int) a->len, &t->width, &t->height, &t->channels, 4);
+    if (!pixels)
+    {
+        return;
+    }
+
+    decoded = SDL_GetPerformanceCounter ();
+    t->built = pack_texture_build (pixels, t->width, t->height, g__textures.filter, &size);
+    stbi_image_free (pixels);
+
+    t->decode_ms = (decoded - start) * 1000.0 / SDL_GetPerformanceFrequency ();
+    t->mips_ms = (SDL_GetPerformanceCounter () - decoded) * 1000.0 / SDL_GetPerformanceFrequency ();
+
+    if (t->built)
+    {
+        t->levels = t->built;
+        t->levels_len = size;
+        _texture_convert (t);
+    }
+
+    if (t->levels)
+    {
+        texcache_store (key, t->levels, t->levels_len, t->channels, t->decode_ms + t->mips_ms + t->convert_ms);
+    }
+}
+
+/* Where the upload reads from: every level, padding between them included */
+static const void *
+_texture_source (const struct texture_load *t, size_t *bytes)
+{
+    const struct pack_texture *tex = t->levels;
+    unsigned int last = tex->levels - 1;
+
+    *bytes = tex->level_offset[last] + tex->level_size[last] - tex->level_offset[0];
+
+    return (const char *) tex + tex->level_offset[0];
+}
+
+static void
+_texture_copy_job (struct job *job)
+{
+    struct texture_load *t = job->data;
+    Uint64 start = SDL_GetPerformanceCounter ();
+    size_t bytes;
+    const void *src = _texture_source (t, &bytes);
+
+    memcpy (t->pbo->mapped, src, bytes);
+    t->copy_ms = (SDL_GetPerformanceCounter () - start) * 1000.0 / SDL_GetPerformanceFrequency ();
+}
+
+/* How each pack_format goes to GL; compressed formats have no format/type */
+struct texture_gl_format
+{
+    GLenum internal;
+    GLenum format;
+    GLenum type;
+    GLint swizzle[4];       // puts the dropped channels back, so shaders still see RGBA
+};
+
+static const struct texture_gl_format g__texture_gl_formats[PACK_FORMAT_MAX] = {
+    { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA } },
+    { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 0, 0, { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA } },
+    { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, 0, { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA } },
+    { GL_R8, GL_RED, GL_UNSIGNED_BYTE, { GL_RED, GL_RED, GL_RED, GL_ONE } },
+    { GL_RG8, GL_RG, GL_UNSIGNED_BYTE, { GL_RED, GL_RED, GL_RED, GL_GREEN } },
+    { GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, { GL_RED, GL_GREEN, GL_BLUE, GL_ONE } },
+    { GL_RGB565, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, { GL_RED, GL_GREEN, GL_BLUE, GL_ONE } },
+};
+
+/**
+ * Issues a glTexImage2D per level. `base` is where _texture_source()'s
+ * bytes are: a pointer to them, or 0 when they are in the bound PBO.
+ */
+static void
+_texture_upload_from (struct texture_load *t, uintptr_t base)
+{
+    const struct pack_texture *tex = t->levels;
+    const struct texture_gl_format *gl = &g__texture_gl_formats[tex->format];
+    GLenum internal = gl->internal;
+
+    /* GL_RGB565 only became a sized format in 4.1; GL_RGB5 gets the same 16 bits elsewhere */
+    if (internal == GL_RGB565 && !GLEW_VERSION_4_1 && !GLEW_ARB_ES2_compatibility)
+    {
+        internal = GL_RGB5;
+    }
+
+    /* R8, RG8 and RGB8 rows needn't be a multiple of 4 bytes */
+    GLCALL (glPixelStorei (GL_UNPACK_ALIGNMENT, 1));
+
+    for (unsigned int i = 0; i < tex->levels; i++)
+    {
+        int lw = tex->width >> i ? tex->width >> i : 1;
+        int lh = tex->height >> i ? tex->height >> i : 1;
+        const void *data = (const void *) (base + tex->level_offset[i] - tex->level_offset[0]);
+
+        if (gl->format)
+        {
+            GLCALL (glTexImage2D (GL_TEXTURE_2D, i, internal, lw, lh, 0, gl->format, gl->type, data));
+        }
+        else
+        {
+            GLCALL (glCompressedTexImage2D (GL_TEXTURE_2D, i, internal, lw, lh, 0, (GLsizei) tex->level_size[i], data));
+        }
+
+        t->vram_bytes += tex->level_size[i];
+        t->rgba8_bytes += (uint64_t) lw * lh * 4;
+    }
+
+    GLCALL (glPixelStorei (GL_UNPACK_ALIGNMENT, 4));
+    GLCALL (glTexParameteriv (GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, gl->swizzle));
+    GLCALL (glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, tex->levels - 1));
+    t->width = tex->width;
+    t->height = tex->height;
+    t->format = tex->format;
+}
+
+/* Uploads (out of t->pbo if it has one) and releases everything the load held */
+static void
+_texture_upload (struct texture_load *t, bool ok)
+{
+    struct texture_stream *s = &g__textures;
+    Uint64 start = SDL_GetPerformanceCounter ();
+    const char *origin = t->asset.source == ASSET_PACK ? ", packed" : t->cached ? ", cached" : "";
+    const void *src = NULL;
+    size_t bytes = 0;
+    double upload_ms;
+    double latency_ms;
+
+    if (ok)
+    {
+        src = _texture_source (t, &bytes);
+        gls_bind_texture (0, t->id);
+    }
+
+    if (t->pbo)
+    {
+        if (ok && pbo_submit (t->pbo))
+        {
+            _texture_upload_from (t, 0);
+        }
+        else if (ok)
+        {
+            GLCALL (glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0));
+            _texture_upload_from (t, (uintptr_t) src);
+        }
+        pbo_finish (t->pbo);
+        t->pbo = NULL;
+    }
+    else if (ok)
+    {
+        _texture_upload_from (t, (uintptr_t) src);
+    }
+
+    upload_ms = t->map_ms + (SDL_GetPerformanceCounter () - start) * 1000.0 / SDL_GetPerformanceFrequency ();
+    latency_ms = (SDL_GetPerformanceCounter () - t->requested) * 1000.0 / SDL_GetPerformanceFrequency ();
+
+    if (t->cached)
+    {
+        texcache_hit_time (t->cached, upload_ms);
+        file_view_close (&t->cache_view);
+        t->cached = NULL;
+    }
+    free (t->built);
+    t->built = NULL;
+    t->levels = NULL;
+    asset_close (&t->asset);
+
+    if (!ok)
+    {
+        t->status = TEXTURE_FAILED;
+        LOG_ERROR ("Failed to load texture '%s'", t->name);
+        return;
+    }
+
+    t->status = TEXTURE_READY;
+    s->bytes += bytes;
+    s->vram_bytes += t->vram_bytes;
+    s->rgba8_bytes += t->rgba8_bytes;
+    s->upload_ms += upload_ms;
+    s->copy_ms += t->copy_ms;
+    if (latency_ms > s->slowest_ms) s->slowest_ms = latency_ms;
+
+    printf ("Load texture '%s' (id=%u w=%d h=%d%s%s) in %.2f ms: %.2f MB, %.2f ms on the GL thread",
+            t->name, t->id, t->width, t->height, origin, t->copy_ms > 0.0 ? ", pbo" : "",
+            latency_ms, bytes / (1024.0 * 1024.0), upload_ms);
+    if (t->copy_ms > 0.0)
+    {
+        printf (" + %.2f ms copying on a worker", t->copy_ms);
+    }
+    printf (" (%.0f MB/s)", bytes / (1024.0 * 1024.0) / ((upload_ms + t->copy_ms) / 1000.0));
+    if (t->decode_ms > 0.0)
+    {
+        printf (", decode %.2f ms, mips %.2f ms", t->decode_ms, t->mips_ms);
+    }
+    if (t->convert_ms > 0.0)
+    {
+        printf (", to %s %.2f ms", pack_format_name (t->format), t->convert_ms);
+    }
+    printf ("; %s, %.2f MB of VRAM, %.2f MB as RGBA8\n", pack_format_name (t->format),
+            t->vram_bytes / (1024.0 * 1024.0), t->rgba8_bytes / (1024.0 * 1024.0));
+}
+
+/**
+ * Returns a texture name that can be bound right away. The same file with
+ * the same `flags` (TEXTURE_*) is only loaded once; later requests get
+ * the first one's name.
+ */
+static unsigned int
+texture_request (const char *file, unsigned int flags)
+{
+    static const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+    struct texture_stream *s = &g__textures;
+    struct texture_load *t;
+
+    for (int i = 0; i < s->count; i++)
+    {
+        if (strcmp (s->loads[i].name, file) == 0 && s->loads[i].flags == flags)
+        {
+            return s->loads[i].id;
+        }
+    }
+
+    ASSERT (s->count < TEXTURE_MAX);
+    t = &s->loads[s->count++];
+    memset (t, 0, sizeof (*t));
+    snprintf (t->name, sizeof (t->name), "%s", file);
+    t->flags = flags;
+    t->requested = SDL_GetPerformanceCounter ();
+
+    GLCALL (glGenTextures (1, &t->id));
+    gls_bind_texture (0, t->id);
+
+    GLCALL (glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+    GLCALL (glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GLCALL (glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE)); // GL_REPEAT?
+    GLCALL (glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE)); // GL_REPEAT?
+    GLCALL (glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0));
+    GLCALL (glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder));
+
+    /* opening is cheap (a mapping, or a read prefetched at startup), decoding is not */
+    if (!asset_open (file, &t->asset))
+    {
+        t->status = TEXTURE_FAILED;
+        return t->id;
+    }
+
+    t->status = TEXTURE_LOADING;
+    t->job.run = _texture_job;
+    t->job.data = t;
+    SDL_AtomicSet (&t->job.done, 0);
+    s->pending++;
+    s->reported = false;
+    workers_submit (&t->job);
+
+    return t->id;
+}
+
+/**
+ * Moves finished loads along: a decoded texture gets a PBO mapped and a
+ * worker copying into it, a filled PBO gets uploaded. Without the ring
+ * decoded textures are uploaded straight away. At most `max` uploads
+ * (all of them if max <= 0); `wait` blocks on a busy PBO rather than
+ * leaving the load for the next call.
+ */
+static void
+_texture_stream_step (int max, bool wait)
+{
+    struct texture_stream *s = &g__textures;
+    int uploaded = 0;
+
+    for (int i = 0; i < s->count && s->pending > 0 && (max <= 0 || uploaded < max); i++)
+    {
+        struct texture_load *t = &s->loads[i];
+        bool ok;
+        size_t bytes;
+
+        if ((t->status != TEXTURE_LOADING && t->status != TEXTURE_COPYING) || !job_done (&t->job))
+        {
+            continue;
+        }
+
+        if (t->status == TEXTURE_LOADING)
+        {
+            ok = t->levels != NULL;
+
+            if (ok && g__pbo.enabled)
+            {
+                Uint64 start = SDL_GetPerformanceCounter ();
+
+                _texture_source (t, &bytes);
+                t->pbo = pbo_acquire (bytes, wait);
+                if (t->pbo)
+                {
+                    t->map_ms = (SDL_GetPerformanceCounter () - start) * 1000.0 / SDL_GetPerformanceFrequency ();
+                    t->status = TEXTURE_COPYING;
+                    t->job.run = _texture_copy_job;
+                    SDL_AtomicSet (&t->job.done, 0);
+                    workers_submit (&t->job);
+                    continue;
+                }
+                if (g__pbo.enabled)
+                {
+                    /* ring busy, try again next time */
+                    continue;
+                }
+            }
+        }
+        else
+        {
+            ok = true;
+        }
+
+        _texture_upload (t, ok);
+        s->pending--;
+        uploaded++;
+    }
+
+    if (s->pending == 0 && !s->reported && s->count > 0)
+    {
+        printf ("Textures: %d streamed, slowest %.2f ms after its request, %.2f MB in %.2f ms on the GL thread",
+                s->count, s->slowest_ms, s->bytes / (1024.0 * 1024.0), s->upload_ms);
+        if (s->copy_ms > 0.0)
+        {
+            printf (" + %.2f ms copying into pixel buffers", s->copy_ms);
+        }
+        printf ("\n");
+        printf ("Textures: %.2f MB of VRAM, %.2f MB less than as RGBA8\n",
+                s->vram_bytes / (1024.0 * 1024.0), (s->rgba8_bytes - s->vram_bytes) / (1024.0 * 1024.0));
+        texcache_report ();
+        s->reported = true;
+    }
+}
+
+/* Called by the GL thread every frame */
+static void
+texture_stream_update (int max)
+{
+    _texture_stream_step (max, false);
+}
+
+/* Blocks until every requested texture is uploaded */
+static void
+texture_stream_wait_all (void)
+{
+    struct texture_stream *s = &g__textures;
+
+    while (s->pending > 0)
+    {
+        for (int i = 0; i < s->count; i++)
+        {
+            struct texture_load *t = &s->loads[i];
+
+            if (t->status == TEXTURE_LOADING || t->status == TEXTURE_COPYING)
+            {
+                job_wait (&t->job);
+            }
+        }
+
+        _texture_stream_step (0, true);
+    }
+}
+
+static void
+texture_stream_init (enum mips_filter filter, bool compress)
+{
+    memset (&g__textures, 0, sizeof (g__textures));
+    g__textures.filter = filter;
+    g__textures.compress = compress && GLEW_EXT_texture_compression_s3tc;
+
+    if (compress && !g__textures.compress)
+    {
+        printf ("No S3TC, textures stay uncompressed\n");
+    }
+
+    /* stbi keeps this in a global, so set it once rather than per decode on the workers */
+    stbi_set_flip_vertically_on_load (1);
+}
+
+/* Jobs point into the table, so they have to finish before it goes */
+static void
+texture_stream_shutdown (void)
+{
+    struct texture_stream *s = &g__textures;
+
+    texture_stream_wait_all ();
+
+    for (int i = 0; i < s->count; i++)
+    {
+        GLCALL (glDeleteTextures (1, &s->loads[i].id));
+    }
+
+    memset (s, 0, sizeof (*s));
+}
+
+#endif
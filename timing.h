@@ -0,0 +1,239 @@
+#ifndef _TIMING_
+#define _TIMING_
+
+/**
+ * Frame pacing.
+ *
+ * Every frame is timed with the performance counter. In the fixed-rate
+ * mode the pacer sleeps for whatever is left of the frame budget (minus
+ * a small margin, since SDL_Delay can oversleep by a scheduler tick) and
+ * then spins for the rest so the next frame starts on time.
+ */
+
+#define PACER_SPIN_MS       2.0
+#define PACER_REPORT_FRAMES 120
+
+enum pace_mode
+{
+    PACE_VSYNC = 0,     // let SDL_GL_SwapWindow block on the display
+    PACE_FIXED,         // sleep + spin to a fixed frame budget
+    PACE_UNCAPPED,      // no waiting at all
+    PACE_MAX
+};
+
+struct pacer_stats
+{
+    unsigned int frames;
+    double work_ms_sum;
+    double work_ms_max;
+    double frame_ms_sum;
+    double frame_ms_min;
+    double frame_ms_max;
+    double jitter_ms_sum;   // |frame time - target|
+    double jitter_ms_max;
+};
+
+struct pacer
+{
+    enum pace_mode mode;
+    double target_ms;
+
+    Uint64 freq;
+    Uint64 frame_start;
+    Uint64 prev_frame_start;
+
+    /* last frame */
+    double work_ms;
+    double frame_ms;
+
+    struct pacer_stats stats;
+};
+
+static char *
+pace_mode_name (enum pace_mode mode)
+{
+    switch (mode)
+    {
+        case PACE_VSYNC: return "vsync";
+        case PACE_FIXED: return "fixed";
+        case PACE_UNCAPPED: return "uncapped";
+        default: return "???";
+    }
+}
+
+static double
+pacer_ms (struct pacer *p, Uint64 ticks)
+{
+    return (double) ticks * 1000.0 / (double) p->freq;
+}
+
+static void
+pacer_stats_reset (struct pacer_stats *s)
+{
+    memset (s, 0, sizeof (*s));
+    s->frame_ms_min = 1e9;
+}
+
+static void
+pacer_set_mode (struct pacer *p, enum pace_mode mode)
+{
+    p->mode = mode;
+
+    if (SDL_GL_SetSwapInterval (mode == PACE_VSYNC ? 1 : 0) != 0)
+    {
+        LOG_ERROR ("Failed to set swap interval: %s", SDL_GetError ());
+    }
+
+    pacer_stats_reset (&p->stats);
+    printf ("Frame pacing: %s (target %.2f ms)\n", pace_mode_name (mode), p->target_ms);
+}
+
+static void
+pacer_init (struct pacer *p, enum pace_mode mode, double target_ms)
+{
+    memset (p, 0, sizeof (*p));
+    p->freq = SDL_GetPerformanceFrequency ();
+    p->target_ms = target_ms;
+    p->frame_start = SDL_GetPerformanceCounter ();
+    p->prev_frame_start = p->frame_start;
+
+    pacer_set_mode (p, mode);
+}
+
+static void
+pacer_begin_frame (struct pacer *p)
+{
+    p->prev_frame_start = p->frame_start;
+    p->frame_start = SDL_GetPerformanceCounter ();
+}
+
+static void
+pacer_report (struct pacer *p)
+{
+    struct pacer_stats *s = &p->stats;
+
+    if (s->frames == 0)
+    {
+        return;
+    }
+
+    printf ("[%s] frames=%u work avg=%.2f max=%.2f | frame avg=%.2f min=%.2f max=%.2f | jitter avg=%.3f max=%.3f (ms)\n",
+            pace_mode_name (p->mode), s->frames,
+            s->work_ms_sum / s->frames, s->work_ms_max,
+            s->frame_ms_sum / s->frames, s->frame_ms_min, s->frame_ms_max,
+            s->jitter_ms_sum / s->frames, s->jitter_ms_max);
+}
+
+/* Call after SDL_GL_SwapWindow. Waits out the rest of the frame budget. */
+static void
+pacer_end_frame (struct pacer *p)
+{
+    struct pacer_stats *s = &p->stats;
+    Uint64 now = SDL_GetPerformanceCounter ();
+
+    p->work_ms = pacer_ms (p, now - p->frame_start);
+
+    if (p->mode == PACE_FIXED)
+    {
+        Uint64 deadline = p->frame_start + (Uint64) (p->target_ms * p->freq / 1000.0);
+        double remaining_ms = pacer_ms (p, deadline > now ? deadline - now : 0);
+
+        if (remaining_ms > PACER_SPIN_MS)
+        {
+            SDL_Delay ((Uint32) (remaining_ms - PACER_SPIN_MS));
+        }
+
+        while (SDL_GetPerformanceCounter () < deadline)
+        {
+            /* spin */
+        }
+    }
+
+    /* previous frame, start to start */
+    p->frame_ms = pacer_ms (p, p->frame_start - p->prev_frame_start);
+
+    if (p->frame_ms > 0.0)
+    {
+        double mean = s->frames ? s->frame_ms_sum / s->frames : p->frame_ms;
+        double target = p->mode == PACE_FIXED ? p->target_ms : mean;
+        double jitter = fabs (p->frame_ms - target);
+
+        s->frames++;
+        s->work_ms_sum += p->work_ms;
+        s->frame_ms_sum += p->frame_ms;
+        s->jitter_ms_sum += jitter;
+        if (p->work_ms > s->work_ms_max) s->work_ms_max = p->work_ms;
+        if (p->frame_ms < s->frame_ms_min) s->frame_ms_min = p->frame_ms;
+        if (p->frame_ms > s->frame_ms_max) s->frame_ms_max = p->frame_ms;
+        if (jitter > s->jitter_ms_max) s->jitter_ms_max = jitter;
+    }
+
+    if (s->frames >= PACER_REPORT_FRAMES)
+    {
+        pacer_report (p);
+        pacer_stats_reset (s);
+    }
+}
+
+/**
+ * Frame clock.
+ *
+ * Sampled once at the start of each frame so every render function sees
+ * the same time. With a fixed step the clock ignores the wall clock and
+ * advances by exactly `step` seconds per frame, which makes runs
+ * reproducible frame for frame.
+ */
+struct frame_clock
+{
+    bool fixed;
+    double step;
+
+    Uint64 freq;
+    Uint64 start;
+    Uint64 frame;
+
+    double secs;    // seconds since the clock was reset
+    double dt;      // seconds since the previous frame
+};
+
+static void
+frame_clock_reset (struct frame_clock *c)
+{
+    c->start = SDL_GetPerformanceCounter ();
+    c->frame = 0;
+    c->secs = 0.0;
+    c->dt = 0.0;
+}
+
+/* step_secs > 0 selects virtual time */
+static void
+frame_clock_init (struct frame_clock *c, double step_secs)
+{
+    memset (c, 0, sizeof (*c));
+    c->fixed = step_secs > 0.0;
+    c->step = step_secs;
+    c->freq = SDL_GetPerformanceFrequency ();
+
+    frame_clock_reset (c);
+}
+
+static void
+frame_clock_tick (struct frame_clock *c)
+{
+    double secs;
+
+    if (c->fixed)
+    {
+        secs = c->frame * c->step;
+    }
+    else
+    {
+        secs = (double) (SDL_GetPerformanceCounter () - c->start) / (double) c->freq;
+    }
+
+    c->dt = c->frame > 0 ? secs - c->secs : 0.0;
+    c->secs = secs;
+    c->frame++;
+}
+
+#endif
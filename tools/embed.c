@@ -0,0 +1,125 @@
+/**
+ * Build step: turns asset files into a C header that is compiled into
+ * the executable (see assets.h).
+ *
+ *   embed [-max <bytes>] <out.h> <file>...
+ *
+ * Each file becomes a byte array (raw, with a terminating 0 that is not
+ * counted in the length, so text can be used in place) plus an entry in
+ * a table sorted by name and ended by a NULL entry. Files bigger than
+ * -max are skipped and stay loose files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EMBED_DEFAULT_MAX (64 * 1024)
+
+static int
+compare_names (const void *a, const void *b)
+{
+    return strcmp (*(char * const *) a, *(char * const *) b);
+}
+
+/* Table key, the file name without any directory */
+static char *
+base_name (char *path)
+{
+    char *slash = strrchr (path, '/');
+    char *backslash = strrchr (path, '\\');
+
+    if (backslash > slash) slash = backslash;
+
+    return slash ? slash + 1 : path;
+}
+
+int
+main (int c, char **v)
+{
+    long max_size = EMBED_DEFAULT_MAX;
+    char **files;
+    int file_count;
+    int embedded = 0;
+    long total = 0;
+    FILE *out;
+    int i = 1;
+
+    if (i + 1 < c && strcmp (v[i], "-max") == 0)
+    {
+        max_size = atol (v[i + 1]);
+        i += 2;
+    }
+
+    if (i >= c)
+    {
+        fprintf (stderr, "Usage: %s [-max <bytes>] <out.h> <file>...\n", v[0]);
+        return 1;
+    }
+
+    out = fopen (v[i], "w");
+    if (!out)
+    {
+        fprintf (stderr, "Failed to open '%s' for writing\n", v[i]);
+        return 1;
+    }
+
+    files = v + i + 1;
+    file_count = c - i - 1;
+    qsort (files, file_count, sizeof (char *), compare_names);
+
+    fprintf (out, "/* Generated by tools/embed.c, do not edit */\n\n");
+
+    for (int f = 0; f < file_count; f++)
+    {
+        FILE *fp = fopen (files[f], "rb");
+        long len;
+        int byte;
+
+        if (!fp)
+        {
+            fprintf (stderr, "Failed to open '%s'\n", files[f]);
+            return 1;
+        }
+
+        fseek (fp, 0, SEEK_END);
+        len = ftell (fp);
+        fseek (fp, 0, SEEK_SET);
+
+        if (len > max_size)
+        {
+            printf ("embed: skipping '%s' (%ld bytes)\n", files[f], len);
+            files[f] = NULL;
+            fclose (fp);
+            continue;
+        }
+
+        fprintf (out, "static const unsigned char _asset_%d[%ld] = {", f, len + 1);
+        for (long b = 0; (byte = fgetc (fp)) != EOF; b++)
+        {
+            fprintf (out, "%s%d,", b % 24 == 0 ? "\n    " : "", byte);
+        }
+        fprintf (out, "\n    0\n};\n\n");
+
+        fclose (fp);
+        embedded++;
+        total += len;
+    }
+
+    fprintf (out, "static const struct embedded_asset g__embedded_assets[] = {\n");
+    for (int f = 0; f < file_count; f++)
+    {
+        if (files[f])
+        {
+            fprintf (out, "    { \"%s\", _asset_%d, sizeof (_asset_%d) - 1 },\n", base_name (files[f]), f, f);
+        }
+    }
+    fprintf (out, "    { NULL, NULL, 0 }\n");
+    fprintf (out, "};\n");
+
+    fclose (out);
+
+    printf ("embed: %d files, %ld bytes -> %s\n", embedded, total, v[i]);
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+/**
+ * Build step: writes an asset pack (layout in packformat.h).
+ *
+ *   pack [-bc] <out.pack> <file>...
+ *
+ * Images (.jpg, .png, .bmp, .tga) are decoded to RGBA8, flipped like
+ * texstream.h does and stored with a full box-filtered mip chain; with
+ * -bc every level is block compressed, BC1 for opaque images and BC3
+ * otherwise. Everything else is stored as-is.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "../packformat.h"
+
+static unsigned char g__zeros[PACK_ALIGN];
+static bool g__compress;
+
+static int
+is_image (const char *name)
+{
+    const char *ext = strrchr (name, '.');
+
+    return ext && (strcmp (ext, ".jpg") == 0 || strcmp (ext, ".png") == 0 ||
+                   strcmp (ext, ".bmp") == 0 || strcmp (ext, ".tga") == 0);
+}
+
+static const char *
+base_name (const char *path)
+{
+    const char *slash = strrchr (path, '/');
+    const char *backslash = strrchr (path, '\\');
+
+    if (backslash > slash) slash = backslash;
+
+    return slash ? slash + 1 : path;
+}
+
+/* Pads the file out to the next PACK_ALIGN boundary, returns the new offset */
+static uint64_t
+align (FILE *out, uint64_t offset)
+{
+    uint64_t pad = (PACK_ALIGN - offset % PACK_ALIGN) % PACK_ALIGN;
+
+    fwrite (g__zeros, 1, pad, out);
+
+    return offset + pad;
+}
+
+/* Decodes an image and writes it as a pack_texture, returns its size */
+static uint64_t
+write_texture (FILE *out, const char *file)
+{
+    unsigned char *rgba;
+    const char *format = "";
+    uint64_t size;
+    int w;
+    int h;
+    int n;
+
+    stbi_set_flip_vertically_on_load (1);
+    rgba = stbi_load (file, &w, &h, &n, 4);
+    if (!rgba)
+    {
+        fprintf (stderr, "Failed to decode '%s': %s\n", file, stbi_failure_reason ());
+        exit (1);
+    }
+
+    if (g__compress)
+    {
+        format = bc_has_alpha (rgba, w, h) ? ", bc3" : ", bc1";
+    }
+
+    size = pack_texture_write (out, rgba, w, h, g__compress);
+    stbi_image_free (rgba);
+
+    if (size == 0)
+    {
+        fprintf (stderr, "Failed to write '%s'\n", file);
+        exit (1);
+    }
+
+    printf ("pack: %-16s texture %dx%d, %d levels%s\n", base_name (file), w, h, mips_level_count (w, h), format);
+
+    return size;
+}
+
+static uint64_t
+write_raw (FILE *out, const char *file)
+{
+    char buf[4096];
+    uint64_t size = 0;
+    size_t n;
+    FILE *fp = fopen (file, "rb");
+
+    if (!fp)
+    {
+        fprintf (stderr, "Failed to open '%s'\n", file);
+        exit (1);
+    }
+
+    while ((n = fread (buf, 1, sizeof (buf), fp)) > 0)
+    {
+        fwrite (buf, 1, n, out);
+        size += n;
+    }
+
+    fclose (fp);
+
+    printf ("pack: %-16s raw %llu bytes\n", base_name (file), (unsigned long long) size);
+
+    return size;
+}
+
+int
+main (int c, char **v)
+{
+    struct pack_header header = {0};
+    struct pack_entry *index;
+    uint64_t offset;
+    int file_count;
+    FILE *out;
+
+    if (c > 1 && strcmp (v[1], "-bc") == 0)
+    {
+        g__compress = true;
+        v++;
+        c--;
+    }
+
+    if (c < 3)
+    {
+        fprintf (stderr, "Usage: %s [-bc] <out.pack> <file>...\n", v[0]);
+        return 1;
+    }
+
+    file_count = c - 2;
+
+    /* keep the index at most half full so probes stay short */
+    header.magic = PACK_MAGIC;
+    header.version = PACK_VERSION;
+    header.index_capacity = 1;
+    while (header.index_capacity < (uint32_t) file_count * 2) header.index_capacity *= 2;
+    header.index_offset = sizeof (header);
+
+    index = calloc (header.index_capacity, sizeof (struct pack_entry));
+    mips_init ();
+
+    out = fopen (v[1], "wb");
+    if (!out || !index)
+    {
+        fprintf (stderr, "Failed to open '%s' for writing\n", v[1]);
+        return 1;
+    }
+
+    /* header and index are rewritten once the payloads are placed */
+    fwrite (&header, sizeof (header), 1, out);
+    fwrite (index, sizeof (struct pack_entry), header.index_capacity, out);
+    offset = header.index_offset + (uint64_t) header.index_capacity * sizeof (struct pack_entry);
+
+    for (int f = 0; f < file_count; f++)
+    {
+        const char *file = v[2 + f];
+        const char *name = base_name (file);
+        uint64_t hash = pack_hash (name);
+        uint32_t mask = header.index_capacity - 1;
+        struct pack_entry *e = &index[hash & mask];
+
+        if (strlen (name) >= PACK_NAME_LEN)
+        {
+            fprintf (stderr, "Name too long: '%s'\n", name);
+            return 1;
+        }
+
+        for (uint32_t i = 1; e->type != PACK_EMPTY; i++)
+        {
+            if (strcmp (e->name, name) == 0)
+            {
+                fprintf (stderr, "Duplicate name: '%s'\n", name);
+                return 1;
+            }
+            e = &index[(hash + i) & mask];
+        }
+
+        offset = align (out, offset);
+
+        e->hash = hash;
+        snprintf (e->name, sizeof (e->name), "%s", name);
+        e->offset = offset;
+        e->type = is_image (file) ? PACK_TEXTURE : PACK_RAW;
+        e->size = e->type == PACK_TEXTURE ? write_texture (out, file) : write_raw (out, file);
+
+        offset += e->size;
+        header.entry_count++;
+    }
+
+    header.file_size = offset;
+
+    fseek (out, 0, SEEK_SET);
+    fwrite (&header, sizeof (header), 1, out);
+    fwrite (index, sizeof (struct pack_entry), header.index_capacity, out);
+    fclose (out);
+    free (index);
+
+    printf ("pack: %u entries, %llu bytes -> %s\n", header.entry_count, (unsigned long long) header.file_size, v[1]);
+
+    return 0;
+}
@@ -1,10 +1,13 @@
 #ifndef _TRACE_
 #define _TRACE_
 
+#include <signal.h>
+
+#ifdef _WIN32
+
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <dbghelp.h>
-#include <signal.h>
 #pragma comment (lib, "dbghelp.lib")
 
 void
@@ -47,4 +50,25 @@ stack_trace (void)
     printf ("----------------------------------------\n");
 }
 
+#else
+
+#include <execinfo.h>
+#include <unistd.h>
+
+void
+stack_trace (void)
+{
+    void *stack[64] = {0};
+    int frame_count = backtrace (stack, 64);
+
+    printf ("----------------------------------------\n");
+    printf ("Call Stack:\n");
+    printf ("----------------------------------------\n");
+    fflush (stdout);
+    backtrace_symbols_fd (stack + 1, frame_count - 1, STDOUT_FILENO);
+    printf ("----------------------------------------\n");
+}
+
+#endif
+
 #endif
@@ -5,9 +5,11 @@ layout (location=1) in vec3 colour;
 
 out vec3 vert_colour;
 
+#include "camera.glsl"
+
 void
 main ()
 {
-    gl_Position = vec4 (pos, 1.0);
+    gl_Position = camera.view_projection * vec4 (pos, 1.0);
     vert_colour = colour;
 }
@@ -0,0 +1,213 @@
+#ifndef _WATCH_
+#define _WATCH_
+
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/**
+ * File watcher for shader hot-reload.
+ *
+ * Runs on its own thread and pushes the names of changed shader files
+ * to whoever polls it (the render thread) through an SPSC queue, so
+ * nothing on the render side ever blocks on the file system. On Linux it
+ * uses inotify on the directory; elsewhere it falls back to checking the
+ * modification time of each registered file a few times a second.
+ */
+
+#define WATCH_MAX_FILES  32
+#define WATCH_QUEUE_LEN  32
+#define WATCH_POLL_MS    250
+
+struct watch_event
+{
+    char name[32];
+    Uint64 time;    // performance counter when the change was seen
+};
+
+struct file_watch
+{
+    SDL_Thread *thread;
+    SDL_atomic_t running;
+    struct spsc_queue events;
+    char dir[256];
+
+    /* stat fallback */
+    int file_count;
+    char files[WATCH_MAX_FILES][32];
+    time_t mtimes[WATCH_MAX_FILES];
+};
+
+static bool
+_watch_is_shader (const char *name)
+{
+    const char *ext = strrchr (name, '.');
+
+    return ext && (strcmp (ext, ".vs") == 0 || strcmp (ext, ".fs") == 0 || strcmp (ext, ".glsl") == 0);
+}
+
+static void
+_watch_push (struct file_watch *w, const char *name)
+{
+    struct watch_event e;
+
+    snprintf (e.name, sizeof (e.name), "%s", name);
+    e.time = SDL_GetPerformanceCounter ();
+
+    if (!spsc_push (&w->events, &e))
+    {
+        LOG_ERROR ("Watch queue full, dropped change to '%s'", name);
+    }
+}
+
+static time_t
+_watch_mtime (struct file_watch *w, const char *name)
+{
+    struct stat st;
+    char path[320];
+
+    snprintf (path, sizeof (path), "%s/%s", w->dir, name);
+
+    return stat (path, &st) == 0 ? st.st_mtime : 0;
+}
+
+#ifdef __linux__
+
+static int
+_watch_thread (void *data)
+{
+    struct file_watch *w = data;
+    char buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    struct pollfd pfd;
+    int fd;
+
+    fd = inotify_init1 (IN_NONBLOCK);
+    if (fd < 0 || inotify_add_watch (fd, w->dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        LOG_ERROR ("inotify failed on '%s', hot reload disabled", w->dir);
+        if (fd >= 0) close (fd);
+        return 1;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (SDL_AtomicGet (&w->running))
+    {
+        ssize_t len;
+
+        /* wake up now and then to notice we are being stopped */
+        if (poll (&pfd, 1, WATCH_POLL_MS) <= 0)
+        {
+            continue;
+        }
+
+        while ((len = read (fd, buf, sizeof (buf))) > 0)
+        {
+            for (char *p = buf; p < buf + len; )
+            {
+                struct inotify_event *e = (struct inotify_event *) p;
+
+                if (e->len > 0 && _watch_is_shader (e->name))
+                {
+                    _watch_push (w, e->name);
+                }
+
+                p += sizeof (struct inotify_event) + e->len;
+            }
+        }
+    }
+
+    close (fd);
+
+    return 0;
+}
+
+#else
+
+static int
+_watch_thread (void *data)
+{
+    struct file_watch *w = data;
+
+    for (int i = 0; i < w->file_count; i++)
+    {
+        w->mtimes[i] = _watch_mtime (w, w->files[i]);
+    }
+
+    while (SDL_AtomicGet (&w->running))
+    {
+        SDL_Delay (WATCH_POLL_MS);
+
+        for (int i = 0; i < w->file_count; i++)
+        {
+            time_t mtime = _watch_mtime (w, w->files[i]);
+
+            if (mtime != 0 && mtime != w->mtimes[i])
+            {
+                w->mtimes[i] = mtime;
+                _watch_push (w, w->files[i]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+#endif
+
+/* Only needed for the stat fallback, inotify sees the whole directory */
+static void
+watch_add_file (struct file_watch *w, const char *name)
+{
+    for (int i = 0; i < w->file_count; i++)
+    {
+        if (strcmp (w->files[i], name) == 0)
+        {
+            return;
+        }
+    }
+
+    if (w->file_count < WATCH_MAX_FILES)
+    {
+        snprintf (w->files[w->file_count++], sizeof (w->files[0]), "%s", name);
+    }
+}
+
+static void
+watch_start (struct file_watch *w, const char *dir)
+{
+    snprintf (w->dir, sizeof (w->dir), "%s", dir);
+    spsc_init (&w->events, sizeof (struct watch_event), WATCH_QUEUE_LEN);
+    SDL_AtomicSet (&w->running, 1);
+
+    w->thread = SDL_CreateThread (_watch_thread, "watch", w);
+    ASSERT (w->thread != NULL);
+}
+
+static void
+watch_stop (struct file_watch *w)
+{
+    if (!w->thread)
+    {
+        return;
+    }
+
+    SDL_AtomicSet (&w->running, 0);
+    SDL_WaitThread (w->thread, NULL);
+    spsc_free (&w->events);
+    w->thread = NULL;
+}
+
+/* Consumer side, returns false when there is nothing new */
+static bool
+watch_poll (struct file_watch *w, struct watch_event *e)
+{
+    return w->thread && spsc_pop (&w->events, e);
+}
+
+#endif
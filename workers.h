@@ -0,0 +1,180 @@
+#ifndef _WORKERS_
+#define _WORKERS_
+
+/**
+ * Small pool of worker threads for blocking or CPU-heavy jobs (file
+ * reads, image decoding) that shouldn't run on the main or render
+ * thread.
+ *
+ * Jobs are caller-owned and must stay alive until they are done. Any
+ * thread may submit; the queue is guarded by one mutex, which is plenty
+ * for the handful of jobs a frame or a startup produces. Waiters sleep on
+ * a condition variable that is broadcast whenever a job finishes.
+ */
+
+#define WORKERS_MAX        8
+#define WORKERS_QUEUE_LEN  256   // power of two
+
+struct job
+{
+    void (*run) (struct job *job);
+    void *data;
+    SDL_atomic_t done;
+};
+
+struct worker_pool
+{
+    SDL_Thread *threads[WORKERS_MAX];
+    int count;
+
+    SDL_mutex *lock;
+    SDL_cond *work;         // queue went from empty to not
+    SDL_cond *space;        // queue went from full to not
+    SDL_cond *finished;     // some job finished
+    struct job *queue[WORKERS_QUEUE_LEN];
+    unsigned int head;
+    unsigned int tail;
+    bool quit;
+
+    unsigned long jobs_run;
+};
+
+static struct worker_pool g__workers;
+
+static int
+_workers_main (void *data)
+{
+    struct worker_pool *w = data;
+
+    for (;;)
+    {
+        struct job *job;
+
+        SDL_LockMutex (w->lock);
+        while (w->head == w->tail && !w->quit)
+        {
+            SDL_CondWait (w->work, w->lock);
+        }
+
+        if (w->head == w->tail)
+        {
+            SDL_UnlockMutex (w->lock);
+            break;
+        }
+
+        job = w->queue[w->tail++ & (WORKERS_QUEUE_LEN - 1)];
+        SDL_CondSignal (w->space);
+        SDL_UnlockMutex (w->lock);
+
+        job->run (job);
+
+        SDL_LockMutex (w->lock);
+        SDL_AtomicSet (&job->done, 1);
+        w->jobs_run++;
+        SDL_CondBroadcast (w->finished);
+        SDL_UnlockMutex (w->lock);
+    }
+
+    return 0;
+}
+
+/* count <= 0 picks one less than the number of cores */
+static void
+workers_start (int count)
+{
+    struct worker_pool *w = &g__workers;
+
+    if (count <= 0) count = SDL_GetCPUCount () - 1;
+    if (count < 1) count = 1;
+    if (count > WORKERS_MAX) count = WORKERS_MAX;
+
+    memset (w, 0, sizeof (*w));
+    w->lock = SDL_CreateMutex ();
+    w->work = SDL_CreateCond ();
+    w->space = SDL_CreateCond ();
+    w->finished = SDL_CreateCond ();
+
+    for (int i = 0; i < count; i++)
+    {
+        w->threads[i] = SDL_CreateThread (_workers_main, "worker", w);
+        ASSERT (w->threads[i] != NULL);
+    }
+
+    w->count = count;
+}
+
+/* Runs whatever is still queued, then joins the threads */
+static void
+workers_stop (void)
+{
+    struct worker_pool *w = &g__workers;
+
+    if (w->count == 0)
+    {
+        return;
+    }
+
+    SDL_LockMutex (w->lock);
+    w->quit = true;
+    SDL_CondBroadcast (w->work);
+    SDL_UnlockMutex (w->lock);
+
+    for (int i = 0; i < w->count; i++)
+    {
+        SDL_WaitThread (w->threads[i], NULL);
+    }
+
+    SDL_DestroyCond (w->finished);
+    SDL_DestroyCond (w->space);
+    SDL_DestroyCond (w->work);
+    SDL_DestroyMutex (w->lock);
+
+    printf ("Workers: %d threads ran %lu jobs\n", w->count, w->jobs_run);
+
+    w->count = 0;
+}
+
+static void
+workers_submit (struct job *job)
+{
+    struct worker_pool *w = &g__workers;
+
+    ASSERT (w->count > 0);
+    SDL_AtomicSet (&job->done, 0);
+
+    SDL_LockMutex (w->lock);
+    while (w->head - w->tail == WORKERS_QUEUE_LEN)
+    {
+        SDL_CondWait (w->space, w->lock);
+    }
+
+    w->queue[w->head++ & (WORKERS_QUEUE_LEN - 1)] = job;
+    SDL_CondSignal (w->work);
+    SDL_UnlockMutex (w->lock);
+}
+
+static bool
+job_done (struct job *job)
+{
+    return SDL_AtomicGet (&job->done) != 0;
+}
+
+static void
+job_wait (struct job *job)
+{
+    struct worker_pool *w = &g__workers;
+
+    if (job_done (job))
+    {
+        return;
+    }
+
+    SDL_LockMutex (w->lock);
+    while (!job_done (job))
+    {
+        SDL_CondWait (w->finished, w->lock);
+    }
+    SDL_UnlockMutex (w->lock);
+}
+
+#endif